@@ -0,0 +1,84 @@
+#include "BodyPrint.h"
+#include "mbed.h"
+
+#include <string.h>
+
+BodyPrint::BodyPrint() : _print(NULL), _len(0), _total(0), _chunked(false) {
+}
+
+void BodyPrint::begin(Print* print) {
+  _print = print;
+  _len = _total = 0;
+  _chunked = false;
+}
+
+size_t BodyPrint::end() {
+  if (_chunked) {
+    writeChunk();
+    _print->print("0\r\n\r\n");
+  } else {
+#ifdef DEBUG
+    printf("Content Length: %d\n", _len);
+#endif
+    _print->print("Content-Length: ");
+    _print->println((long) _len);
+    _print->println();
+    _print->write(_buf, _len);
+  }
+  _print = NULL;
+  return _total;
+}
+
+size_t BodyPrint::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t BodyPrint::write(const uint8_t* buf, size_t size) {
+  size_t left = size;
+  while (left > 0) {
+    if (_len == kBufferSize) {
+      writeChunk();
+    }
+    size_t count = kBufferSize - _len;
+    if (count > left) {
+      count = left;
+    }
+    memcpy(_buf + _len, buf, count);
+    _len += count;
+    buf += count;
+    left -= count;
+  }
+  _total += size;
+  return size;
+}
+
+void BodyPrint::writeChunk() {
+  if (!_chunked) {
+#ifdef DEBUG
+    printf("Body exceeds %d bytes, using chunked encoding\n", kBufferSize);
+#endif
+    _print->println("Transfer-Encoding: chunked");
+    _print->println();
+    _chunked = true;
+  }
+  if (_len == 0) {
+    return;
+  }
+
+  // Chunk size line in hex
+  char size[2 * sizeof(size_t) + 3];
+  char* p = size + sizeof(size) - 1;
+  *p = '\0';
+  *--p = '\n';
+  *--p = '\r';
+  size_t n = _len;
+  do {
+    *--p = "0123456789ABCDEF"[n & 0xF];
+    n >>= 4;
+  } while (n > 0);
+  _print->print(p);
+
+  _print->write(_buf, _len);
+  _print->println();
+  _len = 0;
+}
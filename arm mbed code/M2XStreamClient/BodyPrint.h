@@ -0,0 +1,38 @@
+#ifndef BodyPrint_h
+#define BodyPrint_h
+
+#include "Print.h"
+
+// Print class that renders an HTTP request body once into a fixed scratch
+// buffer, so its Content-Length is known before the body is sent and can
+// never disagree with it. A body that does not fit is sent with chunked
+// transfer encoding instead, one chunk each time the buffer fills up.
+class BodyPrint : public Print {
+public:
+  static const size_t kBufferSize = 128;
+
+  BodyPrint();
+
+  // Starts a body that will be sent to print. The request must have been
+  // written up to the end of the header lines that do not describe the body,
+  // and must use HTTP/1.1 in case the body has to be chunked
+  void begin(Print* print);
+  // Writes the body length header, ends the header and sends the body.
+  // Returns the length of the body
+  size_t end();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buf, size_t size);
+private:
+  // Sends the buffered bytes as one chunk, switching to chunked encoding
+  // on the first call
+  void writeChunk();
+
+  Print* _print;
+  uint8_t _buf[kBufferSize];
+  size_t _len;
+  size_t _total;
+  bool _chunked;
+};
+
+#endif  /* BodyPrint_h */
@@ -0,0 +1,37 @@
+#ifndef BufferPrint_h
+#define BufferPrint_h
+
+#include "Print.h"
+
+#include <string.h>
+
+// Print class that fills a fixed buffer and counts every byte written,
+// including those that did not fit
+class BufferPrint : public Print {
+public:
+  BufferPrint(uint8_t* buf, size_t size) : _buf(buf), _size(size), _len(0) {}
+
+  virtual size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    if (_len < _size) {
+      memcpy(_buf + _len, buf, (size < _size - _len) ? size : _size - _len);
+    }
+    _len += size;
+    return size;
+  }
+
+  // Returns the number of bytes written, which is more than the buffer
+  // size if they did not all fit
+  size_t length() const {
+    return _len;
+  }
+private:
+  uint8_t* _buf;
+  size_t _size;
+  size_t _len;
+};
+
+#endif  /* BufferPrint_h */
@@ -2,56 +2,173 @@
 #include "mbed.h"
 
 #include <stdint.h>
+#include <string.h>
 
-Client::Client() : _len(0), _sock() {
+Client::Client() : _sock(), _rpos(0), _rlen(0), _wlen(0),
+                   _sendTimeout(kDefaultSendTimeout) {
 }
 
 Client::~Client() {
 }
 
 int Client::connect(const char *host, uint16_t port) {
+  _rpos = _rlen = _wlen = 0;
   return _sock.connect(host, port) == 0;
 }
 
+int Client::connect(const char *host, uint16_t port, int timeout) {
+  Timer timer;
+  timer.start();
+  // A failed attempt reports the transport, so the second one fails over
+  for (int attempt = 0; (attempt < 2) && (timer.read_ms() < timeout); attempt++) {
+    if (!connectAsync(host, port)) {
+      continue;
+    }
+    int status;
+    while ((status = connectStatus()) == 0) {
+      if (timer.read_ms() >= timeout) {
+        stop();
+        return 0;
+      }
+      wait_ms(kConnectPollInterval);
+    }
+    if (status == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int Client::connectAsync(const char *host, uint16_t port) {
+  _rpos = _rlen = _wlen = 0;
+  return _sock.connect_async(host, port) == 0;
+}
+
+int Client::connectStatus() {
+  return _sock.connect_status();
+}
+
 size_t Client::write(uint8_t b) {
-  return write(&b, 1);
+  if ((_wlen == kWriteBufferSize) && !send(_wbuf, _wlen)) {
+    return 0;
+  }
+  _wbuf[_wlen++] = b;
+  return 1;
 }
 
 size_t Client::write(const uint8_t *buf, size_t size) {
-  _sock.set_blocking(false, 15000);
+  // Collects small writes so a request goes out in a few large modem writes
+  if (_wlen + size <= kWriteBufferSize) {
+    memcpy(_wbuf + _wlen, buf, size);
+    _wlen += size;
+    return size;
+  }
+  if ((_wlen > 0) && !send(_wbuf, _wlen)) {
+    return 0;
+  }
+  if (size >= kWriteBufferSize) {
+    return send(buf, size) ? size : 0;
+  }
+  memcpy(_wbuf, buf, size);
+  _wlen = size;
+  return size;
+}
+
+bool Client::send(const uint8_t *buf, size_t size) {
+  _wlen = 0;
+  _sock.set_blocking(false, _sendTimeout);
   // NOTE: we know it's dangerous to cast from (const uint8_t *) to (char *),
   // but we are trying to maintain a stable interface between the Arduino
   // one and the mbed one. What's more, while TCPSocketConnection has no
   // intention of modifying the data here, it requires us to send a (char *)
   // typed data. So we belive it's safe to do the cast here.
-  return _sock.send_all(const_cast<char*>((const char*) buf), size);
+  return _sock.send_all(const_cast<char*>((const char*) buf), size) == (int) size;
 }
 
 int Client::available() {
-  if (_len > 0) { return 1; }
-  int ret = read(_buf, 1);
-  if (ret <= 0) { return 0; }
-  _len = ret;
-  return 1;
+  flush();
+  if (_rpos < _rlen) {
+    return _rlen - _rpos;
+  }
+  return fill();
+}
+
+int Client::waitAvailable(int timeout) {
+  int ready = available();
+  if (ready > 0) {
+    return ready;
+  }
+  // Sleeps on the socket instead of polling it
+  _sock.poll(mts::IPStack::READABLE | mts::IPStack::CLOSED, timeout);
+  return fill();
 }
 
 int Client::read() {
-  if (_len > 0) {
-    _len = 0;
-    return _buf[0];
+  flush();
+  if ((_rpos == _rlen) && (fill() == 0)) {
+    return -1;
   }
-  return -1;
+  return _rbuf[_rpos++];
 }
 
 int Client::read(uint8_t *buf, size_t size) {
-  return _sock.receive_all((char*) buf, size);
+  flush();
+  size_t count = MIN(size, _rlen - _rpos);
+  memcpy(buf, _rbuf + _rpos, count);
+  _rpos += count;
+  if (count == size) {
+    return count;
+  }
+
+  // The read-ahead buffer is empty, copy the rest straight out of the
+  // socket's receive buffer
+  if (!(_sock.poll(mts::IPStack::READABLE, 0) & mts::IPStack::READABLE)) {
+    return count;
+  }
+  _sock.set_blocking(false, 0);
+  const char* data;
+  int length;
+  while ((count < size) && ((length = _sock.receive_view(data)) > 0)) {
+    length = MIN((size_t) length, size - count);
+    memcpy(buf + count, data, length);
+    _sock.consume(length);
+    count += length;
+  }
+  return count;
+}
+
+int Client::fill() {
+  // Looks at the socket's receive buffer in place and copies everything up to
+  // the buffer size at once, so the parsers do not cost a socket call per byte
+  _rpos = _rlen = 0;
+  if (!(_sock.poll(mts::IPStack::READABLE, 0) & mts::IPStack::READABLE)) {
+    return 0;
+  }
+  _sock.set_blocking(false, 0);
+  const char* data;
+  int length;
+  // The view ends where the receive buffer wraps, so it can take two passes
+  while ((_rlen < kReadBufferSize) && ((length = _sock.receive_view(data)) > 0)) {
+    length = MIN((size_t) length, kReadBufferSize - _rlen);
+    memcpy(_rbuf + _rlen, data, length);
+    _sock.consume(length);
+    _rlen += length;
+  }
+  return _rlen;
+}
+
+void Client::setTimeout(int timeout) {
+  _sendTimeout = (timeout > 0) ? timeout : 0;
 }
 
 void Client::flush() {
-  // does nothing, TCP stack takes care of this
+  if (_wlen > 0) {
+    send(_wbuf, _wlen);
+  }
 }
 
 void Client::stop() {
+  _rpos = _rlen = _wlen = 0;
   _sock.close();
 }
 
@@ -13,18 +13,53 @@ public:
   ~Client();
 
   virtual int connect(const char *host, uint16_t port);
+  // Connects like connect, but gives up after timeout milliseconds. A
+  // failed attempt is made once more, on another transport if there is one
+  virtual int connect(const char *host, uint16_t port, int timeout);
+  // Starts a connection without waiting, returns 1 if it was started
+  int connectAsync(const char *host, uint16_t port);
+  // Returns 1 once connected, 0 while connecting and -1 on failure
+  int connectStatus();
   virtual size_t write(uint8_t);
   virtual size_t write(const uint8_t *buf, size_t size);
   virtual int available();
+  // Waits up to timeout milliseconds for received data or a close by the
+  // server, returns the number of bytes available
+  int waitAvailable(int timeout);
   virtual int read();
+  // Copies up to size received bytes into buf without waiting, returns the
+  // number of bytes copied
+  virtual int read(uint8_t *buf, size_t size);
+  // Sends the bytes held in the write buffer
   virtual void flush();
+  // Sets the time in milliseconds a send to the socket may wait, the
+  // default is kDefaultSendTimeout
+  void setTimeout(int timeout);
   virtual void stop();
   virtual uint8_t connected();
+  static const int kDefaultSendTimeout = 15000;
 private:
-  virtual int read(uint8_t *buf, size_t size);
-  uint8_t _buf[1];
-  uint8_t _len;
+  // Time between checks of a connection in progress in milliseconds
+  static const int kConnectPollInterval = 10;
+
+  // Bytes fetched from the socket at once by the read-ahead buffer
+  static const size_t kReadBufferSize = 256;
+
+  // Bytes collected by the write buffer before they are sent
+  static const size_t kWriteBufferSize = 256;
+
+  // Refills the read-ahead buffer from the socket, returns the bytes buffered
+  int fill();
+  // Sends bytes to the socket, returns false if they could not all be sent
+  bool send(const uint8_t *buf, size_t size);
+
   TCPSocketConnection _sock;
+  uint8_t _rbuf[kReadBufferSize];
+  size_t _rpos;
+  size_t _rlen;
+  uint8_t _wbuf[kWriteBufferSize];
+  size_t _wlen;
+  int _sendTimeout;
 };
 
 #endif
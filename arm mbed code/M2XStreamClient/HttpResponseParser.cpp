@@ -0,0 +1,185 @@
+#include "HttpResponseParser.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the start of a line with a header name or value without regard
+// to case
+static bool starts_with(const char* line, const char* prefix) {
+  while (*prefix != '\0') {
+    if (tolower(*line++) != tolower(*prefix++)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the value of a header line, skipping the leading spaces
+static const char* header_value(const char* line, const char* name) {
+  line += strlen(name);
+  while (*line == ' ') {
+    line++;
+  }
+  return line;
+}
+
+// Returns true if a comma separated header value holds token, like
+// "chunked" in "gzip, chunked", without regard to case
+static bool has_token(const char* value, const char* token) {
+  size_t length = strlen(token);
+  while (*value != '\0') {
+    while ((*value == ' ') || (*value == ',')) {
+      value++;
+    }
+    const char* end = value;
+    while ((*end != '\0') && (*end != ',') && (*end != ' ') && (*end != ';')) {
+      end++;
+    }
+    if ((end - value == (long) length) && starts_with(value, token)) {
+      return true;
+    }
+    // Skips parameters up to the next element
+    while ((*end != '\0') && (*end != ',')) {
+      end++;
+    }
+    value = end;
+  }
+  return false;
+}
+
+HttpResponseParser::HttpResponseParser() {
+  reset();
+}
+
+void HttpResponseParser::reset() {
+  _state = kStatusLine;
+  _lineLength = 0;
+  _status = 0;
+  _contentLength = -1;
+  _remaining = 0;
+  _chunked = false;
+  _keepAlive = false;
+}
+
+int HttpResponseParser::parse(const char* data, int length,
+                              const char** body, int* bodyLength) {
+  *bodyLength = 0;
+  int used = 0;
+  while ((used < length) && (_state != kDone) && (_state != kError)) {
+    if ((_state == kBody) || (_state == kChunkData) ||
+        (_state == kBodyUntilClose)) {
+      // Hands back the body bytes in place, as many as are framed
+      int count = length - used;
+      if ((_state != kBodyUntilClose) && (count > _remaining)) {
+        count = _remaining;
+      }
+      *body = data + used;
+      *bodyLength = count;
+      used += count;
+      if (_state != kBodyUntilClose) {
+        _remaining -= count;
+        if (_remaining == 0) {
+          _state = (_state == kBody) ? (kDone) : (kChunkEnd);
+        }
+      }
+      return used;
+    }
+
+    char c = data[used++];
+    if (c == '\n') {
+      _line[_lineLength] = '\0';
+      parseLine();
+      _lineLength = 0;
+    } else if ((c != '\r') && (_lineLength < kLineSize - 1)) {
+      _line[_lineLength++] = c;
+    }
+  }
+  return used;
+}
+
+void HttpResponseParser::close() {
+  _keepAlive = false;
+  if (_state == kBodyUntilClose) {
+    _state = kDone;
+  } else if (_state != kDone) {
+    _state = kError;
+  }
+}
+
+void HttpResponseParser::parseLine() {
+  switch (_state) {
+  case kStatusLine:
+    // HTTP/x.y nnn reason
+    if (!starts_with(_line, "HTTP/") || (strchr(_line, ' ') == NULL)) {
+      _state = kError;
+      return;
+    }
+    _status = atoi(strchr(_line, ' ') + 1);
+    // HTTP/1.1 keeps the connection open unless told otherwise
+    _keepAlive = !starts_with(_line, "HTTP/1.0");
+    _state = kHeaderLine;
+    break;
+  case kHeaderLine:
+    if (_lineLength == 0) {
+      startBody();
+    } else if (starts_with(_line, "Content-Length:")) {
+      _contentLength = atol(header_value(_line, "Content-Length:"));
+    } else if (starts_with(_line, "Transfer-Encoding:")) {
+      _chunked = has_token(header_value(_line, "Transfer-Encoding:"),
+                           "chunked");
+    } else if (starts_with(_line, "Connection:")) {
+      const char* value = header_value(_line, "Connection:");
+      if (starts_with(value, "close")) {
+        _keepAlive = false;
+      } else if (starts_with(value, "keep-alive")) {
+        _keepAlive = true;
+      }
+    }
+    break;
+  case kChunkSize:
+    // The size is in hex and may be followed by extensions
+    _remaining = strtol(_line, NULL, 16);
+    if (_remaining < 0) {
+      _state = kError;
+    } else {
+      _state = (_remaining == 0) ? (kTrailer) : (kChunkData);
+    }
+    break;
+  case kChunkEnd:
+    _state = (_lineLength == 0) ? (kChunkSize) : (kError);
+    break;
+  case kTrailer:
+    if (_lineLength == 0) {
+      _state = kDone;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void HttpResponseParser::startBody() {
+  if ((_status >= 100) && (_status < 200) && (_status != 101)) {
+    // An interim response like 100 Continue, the final one follows it
+    _state = kStatusLine;
+    _status = 0;
+    _contentLength = -1;
+    _chunked = false;
+  } else if (_status < 100) {
+    _state = kError;
+  } else if ((_status == 101) || (_status == 204) || (_status == 304)) {
+    // These responses never have a body, whatever their headers say. After
+    // 101 the connection no longer speaks HTTP
+    _keepAlive = _keepAlive && (_status != 101);
+    _state = kDone;
+  } else if (_chunked) {
+    _state = kChunkSize;
+  } else if (_contentLength >= 0) {
+    _remaining = _contentLength;
+    _state = (_remaining == 0) ? (kDone) : (kBody);
+  } else {
+    _keepAlive = false;
+    _state = kBodyUntilClose;
+  }
+}
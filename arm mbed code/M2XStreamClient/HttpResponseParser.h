@@ -0,0 +1,70 @@
+#ifndef HttpResponseParser_h
+#define HttpResponseParser_h
+
+#include <stddef.h>
+
+// Incremental HTTP/1.x response parser. Bytes are fed as they arrive and
+// are looked at once: the status line and headers are parsed a line at a
+// time, and the body is framed by Content-Length, chunked transfer encoding
+// or the close of the connection. Interim 1xx responses are skipped. Body
+// bytes are handed back to the caller in place, so they can go straight to a
+// JSON parser.
+class HttpResponseParser {
+public:
+  // Longest header line prefix that is kept, enough for the headers used
+  static const int kLineSize = 40;
+
+  HttpResponseParser();
+
+  // Prepares the parser for a new response
+  void reset();
+  // Parses up to length bytes of data. If body bytes are found, parsing
+  // stops after them and body and bodyLength describe them, otherwise
+  // bodyLength is 0. Returns the number of bytes used
+  int parse(const char* data, int length,
+            const char** body, int* bodyLength);
+  // Tells the parser that the server closed the connection, which ends a
+  // body that is framed by the close
+  void close();
+
+  // Returns the status code, 0 until the status line was parsed
+  int status() const { return _status; }
+  // Returns true once the headers have been parsed
+  bool headersDone() const { return _state > kHeaderLine; }
+  // Returns true once the whole response has been parsed
+  bool done() const { return _state == kDone; }
+  // Returns true if the response is malformed
+  bool error() const { return _state == kError; }
+  // Returns true if the connection can be used for another request
+  // after the response
+  bool keepAlive() const { return _keepAlive; }
+private:
+  enum State {
+    kStatusLine,
+    kHeaderLine,
+    kBody,
+    kBodyUntilClose,
+    kChunkSize,
+    kChunkData,
+    kChunkEnd,
+    kTrailer,
+    kDone,
+    kError
+  };
+
+  // Handles a complete line in the line based states
+  void parseLine();
+  // Chooses the body framing once the headers are done
+  void startBody();
+
+  State _state;
+  char _line[kLineSize];
+  int _lineLength;
+  int _status;
+  long _contentLength;
+  long _remaining;
+  bool _chunked;
+  bool _keepAlive;
+};
+
+#endif  /* HttpResponseParser_h */
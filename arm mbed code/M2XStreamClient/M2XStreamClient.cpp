@@ -4,15 +4,18 @@
 
 #include "StreamParseFunctions.h"
 #include "LocationParseFunctions.h"
-
-#define HEX(t_) ((char) (((t_) > 9) ? ((t_) - 10 + 'A') : ((t_) + '0')))
-#define MAX_DOUBLE_DIGITS 7
+#include "HttpResponseParser.h"
+#include "BufferPrint.h"
 
 
 const char* M2XStreamClient::kDefaultM2XHost = "api-m2x.att.com";
 const char* kUserAgentLine = "User-Agent: M2X Arduino Client/0.1";
+const char* kFormContentType = "application/x-www-form-urlencoded";
+const char* kJsonContentType = "application/json";
 
 static int print_encoded_string(Print* print, const char* str);
+static int write_header_block(Print* print, const char* key,
+                              const char* host, int port);
 
 M2XStreamClient::M2XStreamClient(Client* client,
                                  const char* key,
@@ -21,175 +24,252 @@ M2XStreamClient::M2XStreamClient(Client* client,
                                              _key(key),
                                              _host(host),
                                              _port(port),
-                                             _null_print() {
+                                             _body(),
+                                             _keepAlive(false),
+                                             _responseStarted(false),
+                                             _retrying(false),
+                                             _timeout(kDefaultTimeout),
+                                             _usageMark(),
+                                             _requestUsage() {
+  // The header lines that are the same for every request are built once
+  BufferPrint counter(NULL, 0);
+  _headerLength = write_header_block(&counter, key, host, port);
+  _header = new uint8_t[_headerLength];
+  BufferPrint header(_header, _headerLength);
+  write_header_block(&header, key, host, port);
+}
+
+M2XStreamClient::~M2XStreamClient() {
+  delete[] _header;
+}
+
+void M2XStreamClient::setTimeout(int timeout) {
+  _timeout = timeout;
 }
 
 int M2XStreamClient::send(const char* feedId,
                           const char* streamName,
                           double value) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-    writeSendHeader(feedId, streamName,
-                    // 6 for "value="
-                    _null_print.print(value) + 6);
-    _client->print("value=");
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
+    writeSendHeader(feedId, streamName);
+    _body.begin(_client);
+    _body.print("value=");
     // value is a double, does not need encoding
-    _client->print(value);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-
-  return readStatusCode(true);
+    _body.print(value, MAX_DOUBLE_DIGITS);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
 }
 
 int M2XStreamClient::send(const char* feedId,
                           const char* streamName,
                           long value) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-    writeSendHeader(feedId, streamName,
-                    // 6 for "value="
-                    _null_print.print(value) + 6);
-
-    _client->print("value=");
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
+    writeSendHeader(feedId, streamName);
+    _body.begin(_client);
+    _body.print("value=");
     // value is a long, does not need encoding
-    _client->print(value);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-
-  return readStatusCode(true);
+    _body.print(value);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
 }
 
 int M2XStreamClient::send(const char* feedId,
                           const char* streamName,
                           int value) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-    writeSendHeader(feedId, streamName,
-                    // 6 for "value="
-                    _null_print.print(value) + 6);
-
-    _client->print("value=");
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
+    writeSendHeader(feedId, streamName);
+    _body.begin(_client);
+    _body.print("value=");
     // value is an int, does not need encoding
-    _client->print(value);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-
-  return readStatusCode(true);
+    _body.print(value);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
 }
 
 int M2XStreamClient::send(const char* feedId,
                           const char* streamName,
                           const char* value) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-    writeSendHeader(feedId, streamName,
-                    // 6 for "value="
-                    _null_print.print(value) + 6);
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
+    writeSendHeader(feedId, streamName);
+    _body.begin(_client);
+    _body.print("value=");
+    print_encoded_string(&_body, value);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
+}
 
-    _client->print("value=");
-    print_encoded_string(_client, value);
-  } else {
+int M2XStreamClient::sendBatch(const char* feedId, ValueBatch& batch,
+                               bool force) {
+  if ((batch.count() == 0) || (!force && !batch.isDue())) {
+    return E_OK;
+  }
+  char* data;
+  size_t size;
+  if (!batch.build(&data, &size)) {
+    return E_INVALID;
+  }
+
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      free(data);
+      return E_NOCONNECTION;
+    }
+    // Values of several streams are posted to the feed itself, the values
+    // path only exists for a single stream
+    _client->print("POST /v1/feeds/");
+    print_encoded_string(_client, feedId);
+    _client->println(" HTTP/1.1");
+
+    // The body is already built, so its length is known
+    writeHttpHeader(kJsonContentType);
 #ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
+    printf("Content Length: %d\n", size);
 #endif
-    return E_NOCONNECTION;
+    _client->print("Content-Length: ");
+    _client->println((long) size);
+    _client->println();
+    _client->write((const uint8_t*) data, size);
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+
+  free(data);
+  if ((status >= 200) && (status < 300)) {
+    batch.clear();
   }
-
-  return readStatusCode(true);
+  return status;
 }
 
 int M2XStreamClient::receive(const char* feedId, const char* streamName,
                              stream_value_read_callback callback, void* context) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
+  stream_parsing_context_state state;
+  jsonlite_parser_callbacks cbs = jsonlite_default_callbacks;
+  cbs.key_found = on_stream_key_found;
+  cbs.string_found = on_stream_string_found;
+  cbs.context.client_state = &state;
+
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
     _client->print("GET /v1/feeds/");
     print_encoded_string(_client, feedId);
     _client->print("/streams/");
     print_encoded_string(_client, streamName);
-    _client->println("/values HTTP/1.0");
-
-    writeHttpHeader(-1);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-  int status = readStatusCode(false);
-  if (status == 200) {
-    readStreamValue(callback, context);
-  }
-
-  close();
+    _client->println("/values HTTP/1.1");
+
+    writeHttpHeader(NULL);
+    state.state = state.index = 0;
+    state.callback = callback;
+    state.context = context;
+    status = readResponse(&cbs);
+  } while (retry(status, reused));
   return status;
 }
 
 int M2XStreamClient::readLocation(const char* feedId,
                                   location_read_callback callback,
                                   void* context) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
+  location_parsing_context_state state;
+  jsonlite_parser_callbacks cbs = jsonlite_default_callbacks;
+  cbs.key_found = on_location_key_found;
+  cbs.string_found = on_location_string_found;
+  cbs.context.client_state = &state;
+
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
     _client->print("GET /v1/feeds/");
     print_encoded_string(_client, feedId);
-    _client->println("/location HTTP/1.0");
-
-    writeHttpHeader(-1);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-  int status = readStatusCode(false);
-  if (status == 200) {
-    readLocation(callback, context);
-  }
-
-  close();
+    _client->println("/location HTTP/1.1");
+
+    writeHttpHeader(NULL);
+    state.state = state.index = 0;
+    state.callback = callback;
+    state.context = context;
+    status = readResponse(&cbs);
+  } while (retry(status, reused));
   return status;
 }
 
+// Bytes that are sent as they are by percent-encoding, which are the
+// unreserved characters of RFC 3986, Section 2.3
+static const uint8_t kUnreserved[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x00
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,  // 0x20
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,  // 0x30
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x40
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,  // 0x50
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x60
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,  // 0x70
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x80
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x90
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xA0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xB0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xC0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xD0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xE0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   // 0xF0
+};
+static const char kHexDigits[] = "0123456789ABCDEF";
+
 // Encodes and prints string using Percent-encoding specified
-// in RFC 1738, Section 2.2
+// in RFC 1738, Section 2.2. Runs of bytes that need no encoding are
+// written at once. With a NULL print only the encoded length is returned
 static int print_encoded_string(Print* print, const char* str) {
   int bytes = 0;
-  for (int i = 0; str[i] != 0; i++) {
-    if (((str[i] >= 'A') && (str[i] <= 'Z')) ||
-        ((str[i] >= 'a') && (str[i] <= 'z')) ||
-        ((str[i] >= '0') && (str[i] <= '9')) ||
-        (str[i] == '-') || (str[i] == '_') ||
-        (str[i] == '.') || (str[i] == '~')) {
-      bytes += print->print(str[i]);
+  const uint8_t* p = (const uint8_t*) str;
+  while (*p != 0) {
+    const uint8_t* run = p;
+    while (kUnreserved[*p]) {
+      p++;
+    }
+    if (p != run) {
+      bytes += print ? print->write(run, p - run) : p - run;
+      continue;
+    }
+    if (print) {
+      uint8_t escape[3] = {'%', kHexDigits[*p >> 4], kHexDigits[*p & 0xF]};
+      bytes += print->write(escape, 3);
     } else {
-      // Encode all other characters
-      bytes += print->print('%');
-      bytes += print->print(HEX(str[i] / 16));
-      bytes += print->print(HEX(str[i] % 16));
+      bytes += 3;
     }
+    p++;
   }
   return bytes;
 }
@@ -205,7 +285,7 @@ static int write_location_data(Print* print, const char* name,
   bytes += print->print("&longitude=");
   bytes += print->print(longitude, MAX_DOUBLE_DIGITS);
   bytes += print->print("&elevation=");
-  bytes += print->print(elevation);
+  bytes += print->print(elevation, MAX_DOUBLE_DIGITS);
   return bytes;
 }
 
@@ -229,26 +309,23 @@ int M2XStreamClient::updateLocation(const char* feedId,
                                     double latitude,
                                     double longitude,
                                     double elevation) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-
-    int length = write_location_data(&_null_print, name, latitude, longitude,
-                                     elevation);
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
     _client->print("PUT /v1/feeds/");
     print_encoded_string(_client, feedId);
-    _client->println("/location HTTP/1.0");
-
-    writeHttpHeader(length);
-    write_location_data(_client, name, latitude, longitude, elevation);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-  return readStatusCode(true);
+    _client->println("/location HTTP/1.1");
+
+    writeHttpHeader(kFormContentType);
+    _body.begin(_client);
+    write_location_data(&_body, name, latitude, longitude, elevation);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
 }
 
 int M2XStreamClient::updateLocation(const char* feedId,
@@ -256,329 +333,243 @@ int M2XStreamClient::updateLocation(const char* feedId,
                                     const char* latitude,
                                     const char* longitude,
                                     const char* elevation) {
-  if (_client->connect(_host, _port)) {
-#ifdef DEBUG
-    printf("Connected to M2X server!\n");
-#endif
-
-    int length = write_location_data(&_null_print, name, latitude, longitude,
-                                     elevation);
+  bool reused;
+  int status;
+  do {
+    if (!open(reused)) {
+      return E_NOCONNECTION;
+    }
     _client->print("PUT /v1/feeds/");
     print_encoded_string(_client, feedId);
-    _client->println("/location HTTP/1.0");
-
-    writeHttpHeader(length);
-    write_location_data(_client, name, latitude, longitude, elevation);
-  } else {
-#ifdef DEBUG
-    printf("ERROR: Cannot connect to M2X server!\n");
-#endif
-    return E_NOCONNECTION;
-  }
-  return readStatusCode(true);
+    _client->println("/location HTTP/1.1");
+
+    writeHttpHeader(kFormContentType);
+    _body.begin(_client);
+    write_location_data(&_body, name, latitude, longitude, elevation);
+    _body.end();
+    status = readResponse(NULL);
+  } while (retry(status, reused));
+  return status;
 }
 
 void M2XStreamClient::writeSendHeader(const char* feedId,
-                                      const char* streamName,
-                                      int contentLength) {
+                                      const char* streamName) {
   _client->print("PUT /v1/feeds/");
   print_encoded_string(_client, feedId);
   _client->print("/streams/");
   print_encoded_string(_client, streamName);
-  _client->println(" HTTP/1.0");
+  _client->println(" HTTP/1.1");
   
-  writeHttpHeader(contentLength);
+  writeHttpHeader(kFormContentType);
 }
 
-void M2XStreamClient::writeHttpHeader(int contentLength) {
-  _client->println(kUserAgentLine);
-  _client->print("X-M2X-KEY: ");
-  _client->println(_key);
-  
-  _client->print("Host: ");
-  print_encoded_string(_client, _host);
-  if (_port != kDefaultM2XPort) {
-    _client->print(":");
-    // port is an integer, does not need encoding
-    _client->print(_port);
-  }
-  _client->println();
+void M2XStreamClient::writeHttpHeader(const char* contentType) {
+  _client->write(_header, _headerLength);
 
-  if (contentLength > 0) {
-    _client->println("Content-Type: application/x-www-form-urlencoded");
-#ifdef DEBUG
-    printf("Content Length: %d\n", contentLength);
-#endif
-    _client->print("Content-Length: ");
-    _client->println(contentLength);
+  if (contentType != NULL) {
+    _client->print("Content-Type: ");
+    _client->println(contentType);
+  } else {
+    _client->println();
   }
-  _client->println();
 }
 
-int M2XStreamClient::waitForString(const char* str) {
-  int currentIndex = 0;
-  if (str[currentIndex] == '\0') return E_OK;
-
-  while (true) {
-    while (_client->available()) {
-      char c = _client->read();
-#ifdef DEBUG
-      printf("%c", c);
-#endif
-
-      if ((str[currentIndex] == '*') ||
-          (c == str[currentIndex])) {
-        currentIndex++;
-        if (str[currentIndex] == '\0') {
-          return E_OK;
-        }
-      } else {
-        // start from the beginning
-        currentIndex = 0;
-      }
-    }
-
-    if (!_client->connected()) {
-#ifdef DEBUG
-      printf("ERROR: The client is disconnected from the server!\n");
-#endif
-      close();
-      return E_DISCONNECTED;
-    }
-
-    delay(1000);
+static int write_header_block(Print* print, const char* key,
+                              const char* host, int port) {
+  int bytes = 0;
+  bytes += print->println(kUserAgentLine);
+  bytes += print->print("X-M2X-KEY: ");
+  bytes += print->println(key);
+
+  bytes += print->print("Host: ");
+  bytes += print_encoded_string(print, host);
+  if (port != M2XStreamClient::kDefaultM2XPort) {
+    bytes += print->print(":");
+    // port is an integer, does not need encoding
+    bytes += print->print(port);
   }
-  // never reached here
-  return E_NOTREACHABLE;
+  bytes += print->println();
+  return bytes;
 }
 
-int M2XStreamClient::readStatusCode(bool closeClient) {
-  int responseCode = 0;
-  int ret = waitForString("HTTP/*.* ");
-  if (ret != E_OK) {
-    if (closeClient) close();
-    return ret;
+bool M2XStreamClient::open(bool& reused) {
+  // The request deadline covers connecting, writing the request and reading
+  // the response, it is not restarted when a request is sent again
+  if (!_retrying) {
+    _requestTimer.reset();
+    _requestTimer.start();
+    _usageMark = mts::Cellular::getInstance()->getDataUsage();
   }
+  _retrying = false;
 
-  // ret is not needed from here(since it must be E_OK), so we can use it
-  // as a regular variable now.
-  ret = 0;
-  while (true) {
-    while (_client->available()) {
-      char c = _client->read();
+  reused = _keepAlive && _client->connected();
+  _keepAlive = false;
+  if (reused && _client->available()) {
+    // Nothing is expected between responses, unread bytes mean the server
+    // ended the connection, so it is not reused
 #ifdef DEBUG
-      printf("%c", c);
+    printf("Discarding connection with unexpected data!\n");
 #endif
-      responseCode = responseCode * 10 + (c - '0');
-      ret++;
-      if (ret == 3) {
-        if (closeClient) close();
-        return responseCode;
-      }
-    }
-
-    if (!_client->connected()) {
+    close();
+    reused = false;
+  }
+  if (reused) {
 #ifdef DEBUG
-      printf("ERROR: The client is disconnected from the server!\n");
+    printf("Reusing connection to M2X server!\n");
 #endif
-      if (closeClient) close();
-      return E_DISCONNECTED;
-    }
-
-    delay(1000);
+    _client->setTimeout(_timeout - _requestTimer.read_ms());
+    return true;
   }
-
-  // never reached here
-  return E_NOTREACHABLE;
-}
-
-int M2XStreamClient::readContentLength() {
-  int ret = waitForString("Content-Length: ");
-  if (ret != E_OK) {
-    return ret;
+  int remaining = _timeout - _requestTimer.read_ms();
+  if ((remaining > 0) && _client->connect(_host, _port, remaining)) {
+#ifdef DEBUG
+    printf("Connected to M2X server!\n");
+#endif
+    // Writing the request may take what is left of the deadline
+    _client->setTimeout(_timeout - _requestTimer.read_ms());
+    return true;
   }
-
-  // From now on, ret is not needed, we can use it
-  // to keep the final result
-  ret = 0;
-  while (true) {
-    while (_client->available()) {
-      char c = _client->read();
 #ifdef DEBUG
-      printf("%c", c);
+  printf("ERROR: Cannot connect to M2X server!\n");
 #endif
-      if ((c == '\r') || (c == '\n')) {
-        return (ret == 0) ? (E_INVALID) : (ret);
-      } else {
-        ret = ret * 10 + (c - '0');
-      }
-    }
+  recordUsage();
+  return false;
+}
 
+bool M2XStreamClient::retry(int status, bool reused) {
+  // The server may close an idle connection just as a request is sent on
+  // it, so a request on a reused connection that was closed before any
+  // response byte arrived is sent once more on a new one. Once the server
+  // answered it may have stored the values, so a POST is never sent twice
+  _retrying = reused && !_responseStarted &&
+              ((status == E_DISCONNECTED) || (status == E_INVALID) || (status == 0));
+  return _retrying;
+}
+
+int M2XStreamClient::waitForData() {
+  while (!_client->available()) {
     if (!_client->connected()) {
 #ifdef DEBUG
       printf("ERROR: The client is disconnected from the server!\n");
 #endif
       return E_DISCONNECTED;
     }
-
-    delay(1000);
+    int remaining = _timeout - _requestTimer.read_ms();
+    if (remaining <= 0) {
+#ifdef DEBUG
+      printf("ERROR: Timed out waiting for the server!\n");
+#endif
+      return E_TIMEOUT;
+    }
+    _client->waitAvailable(remaining);
   }
-
-  // never reached here
-  return E_NOTREACHABLE;
+  return E_OK;
 }
 
-int M2XStreamClient::skipHttpHeader() {
-  return waitForString("\r\n\r\n");
-}
-
-void M2XStreamClient::close() {
-  // Eats up buffered data before closing
-  _client->flush();
-  _client->stop();
-}
-
-int M2XStreamClient::readStreamValue(stream_value_read_callback callback,
-                                     void* context) {
-  const int BUF_LEN = 32;
+int M2XStreamClient::readResponse(const jsonlite_parser_callbacks* cbs) {
+  const int BUF_LEN = 64;
   char buf[BUF_LEN];
-
-  int length = readContentLength();
-  if (length < 0) {
-    close();
-    return length;
-  }
-
-  int index = skipHttpHeader();
-  if (index != E_OK) {
-    close();
-    return index;
-  }
-  index = 0;
-
-  stream_parsing_context_state state;
-  state.state = state.index = 0;
-  state.callback = callback;
-  state.context = context;
-
-  jsonlite_parser_callbacks cbs = jsonlite_default_callbacks;
-  cbs.key_found = on_stream_key_found;
-  cbs.string_found = on_stream_string_found;
-  cbs.context.client_state = &state;
-
-  jsonlite_parser p = jsonlite_parser_init(jsonlite_parser_estimate_size(5));
-  jsonlite_parser_set_callback(p, &cbs);
-
-  jsonlite_result result = jsonlite_result_unknown;
-  while (index < length) {
-    int i = 0;
-
-#ifdef DEBUG
-    printf("Received Data: ");
-#endif
-    while ((i < BUF_LEN) && _client->available()) {
-      buf[i++] = _client->read();
-#ifdef DEBUG
-      printf("%c", buf[i - 1]);
-#endif
+  HttpResponseParser parser;
+  jsonlite_parser p = NULL;
+
+  _responseStarted = false;
+  while (!parser.done()) {
+    int length = _client->read((uint8_t*) buf, BUF_LEN);
+    if (length > 0) {
+      _responseStarted = true;
+    }
+    if (length == 0) {
+      int ret = waitForData();
+      if (ret == E_DISCONNECTED) {
+        // Ends a body that is framed by the close of the connection
+        parser.close();
+        if (parser.done()) {
+          break;
+        }
+      }
+      if (ret != E_OK) {
+        if (p != NULL) {
+          jsonlite_parser_release(p);
+        }
+        close();
+        recordUsage();
+        return ret;
+      }
+      continue;
     }
 #ifdef DEBUG
-      printf("\n");
+    printf("Received Data: %.*s\n", length, buf);
 #endif
 
-    if ((!_client->connected()) &&
-        (!_client->available()) &&
-        ((index + i) < length)) {
-      jsonlite_parser_release(p);
-      close();
-      return E_NOCONNECTION;
-    }
+    // Status line, headers and body are parsed in the same pass, body bytes
+    // of a successful response go straight to the JSON parser
+    const char* data = buf;
+    while ((length > 0) && !parser.done()) {
+      const char* body;
+      int bodyLength;
+      int used = parser.parse(data, length, &body, &bodyLength);
+      data += used;
+      length -= used;
+      if (parser.error()) {
+        if (p != NULL) {
+          jsonlite_parser_release(p);
+        }
+        close();
+        recordUsage();
+        return E_INVALID;
+      }
 
-    result = jsonlite_parser_tokenize(p, buf, i);
-    if ((result != jsonlite_result_ok) &&
-        (result != jsonlite_result_end_of_stream)) {
-      jsonlite_parser_release(p);
-      close();
-      return E_JSON_INVALID;
+      if ((bodyLength > 0) && (cbs != NULL) && (parser.status() == 200)) {
+        if (p == NULL) {
+          p = jsonlite_parser_init(jsonlite_parser_estimate_size(5));
+          jsonlite_parser_set_callback(p, cbs);
+        }
+        jsonlite_result result = jsonlite_parser_tokenize(p, body, bodyLength);
+        if ((result != jsonlite_result_ok) &&
+            (result != jsonlite_result_end_of_stream)) {
+#ifdef DEBUG
+          printf("ERROR: Invalid JSON in the response!\n");
+#endif
+          // The rest of the body is still read, so the connection can be reused
+          cbs = NULL;
+        }
+      }
     }
-
-    index += i;
-  }
-
-  jsonlite_parser_release(p);
-  close();
-  return (result == jsonlite_result_ok) ? (E_OK) : (E_JSON_INVALID);
-}
-
-int M2XStreamClient::readLocation(location_read_callback callback,
-                                  void* context) {
-  const int BUF_LEN = 40;
-  char buf[BUF_LEN];
-
-  int length = readContentLength();
-  if (length < 0) {
-    close();
-    return length;
   }
 
-  int index = skipHttpHeader();
-  if (index != E_OK) {
-    close();
-    return index;
+  if (p != NULL) {
+    jsonlite_parser_release(p);
   }
-  index = 0;
-
-  location_parsing_context_state state;
-  state.state = state.index = 0;
-  state.callback = callback;
-  state.context = context;
-
-  jsonlite_parser_callbacks cbs = jsonlite_default_callbacks;
-  cbs.key_found = on_location_key_found;
-  cbs.string_found = on_location_string_found;
-  cbs.context.client_state = &state;
-
-  jsonlite_parser p = jsonlite_parser_init(jsonlite_parser_estimate_size(5));
-  jsonlite_parser_set_callback(p, &cbs);
+  _keepAlive = parser.keepAlive();
+  finish();
+  recordUsage();
+  return parser.status();
+}
 
-  jsonlite_result result = jsonlite_result_unknown;
-  while (index < length) {
-    int i = 0;
+mts::Cellular::DataUsage M2XStreamClient::getRequestUsage() {
+  return _requestUsage;
+}
 
+void M2XStreamClient::recordUsage() {
+  // Requests share a connection when it is kept alive, so the usage is taken
+  // from the difference of the counters instead of the socket usage
+  _requestUsage = mts::Cellular::getInstance()->getDataUsageSince(_usageMark);
 #ifdef DEBUG
-    printf("Received Data: ");
-#endif
-    while ((i < BUF_LEN) && _client->available()) {
-      buf[i++] = _client->read();
-#ifdef DEBUG
-      printf("%c", buf[i - 1]);
+  printf("Request usage: payload Tx[%lu] Rx[%lu] command Tx[%lu] Rx[%lu]\n",
+         _requestUsage.payloadTx, _requestUsage.payloadRx,
+         _requestUsage.commandTx, _requestUsage.commandRx);
 #endif
-    }
-#ifdef DEBUG
-    printf("\n");
-#endif
-
-    if ((!_client->connected()) &&
-        (!_client->available()) &&
-        ((index + i) < length)) {
-      jsonlite_parser_release(p);
-      close();
-      return E_NOCONNECTION;
-    }
-
-    result = jsonlite_parser_tokenize(p, buf, i);
-    if ((result != jsonlite_result_ok) &&
-        (result != jsonlite_result_end_of_stream)) {
-      jsonlite_parser_release(p);
-      close();
-      return E_JSON_INVALID;
-    }
+}
 
-    index += i;
+void M2XStreamClient::finish() {
+  if (!_keepAlive) {
+    close();
   }
-
-  jsonlite_parser_release(p);
-  close();
-  return (result == jsonlite_result_ok) ? (E_OK) : (E_JSON_INVALID);
 }
 
+void M2XStreamClient::close() {
+  // Sends any request data still in the write buffer before closing
+  _client->flush();
+  _client->stop();
+  _keepAlive = false;
+}
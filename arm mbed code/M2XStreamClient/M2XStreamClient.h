@@ -2,12 +2,16 @@
 #define M2XStreamClient_h
 
 #define MIN(a, b) (((a) > (b))?(b):(a))
+#define MAX_DOUBLE_DIGITS 7
 
 #include "mbed.h"
 #include "Client.h"
+#include "Cellular.h"
 #include "Utility.h"
+#include <jsonlite.h>
 
-#include "NullPrint.h"
+#include "BodyPrint.h"
+#include "ValueBatch.h"
 
 static const int E_OK = 0;
 static const int E_NOCONNECTION = -1;
@@ -15,6 +19,7 @@ static const int E_DISCONNECTED = -2;
 static const int E_NOTREACHABLE = -3;
 static const int E_INVALID = -4;
 static const int E_JSON_INVALID = -5;
+static const int E_TIMEOUT = -6;
 
 typedef void (*stream_value_read_callback)(const char* at,
                                            const char* value,
@@ -33,11 +38,19 @@ class M2XStreamClient {
 public:
   static const char* kDefaultM2XHost;
   static const int kDefaultM2XPort = 80;
+  static const int kDefaultTimeout = 15000;
 
   M2XStreamClient(Client* client,
                   const char* key,
                   const char* host = kDefaultM2XHost,
                   int port = kDefaultM2XPort);
+  ~M2XStreamClient();
+
+  // Sets the time in milliseconds a request may take from connecting to
+  // reading the last byte of the response. E_NOCONNECTION is returned if
+  // connecting takes all of it, E_TIMEOUT if the response does not arrive
+  // in time. The default is kDefaultTimeout
+  void setTimeout(int timeout);
 
   // Update data stream, returns the HTTP status code
   int send(const char* feedId, const char* streamName, double value);
@@ -45,6 +58,13 @@ public:
   int send(const char* feedId, const char* streamName, int value);
   int send(const char* feedId, const char* streamName, const char* value);
 
+  // Posts the values of a batch, which may be for several streams of the
+  // feed, in one request. Nothing is sent unless the batch is due by its
+  // flush policy or force is set, in which case E_OK is returned. The batch
+  // is cleared once the server accepted it, otherwise the values are kept
+  // to be sent again. Returns the HTTP status code
+  int sendBatch(const char* feedId, ValueBatch& batch, bool force = false);
+
   // Receive values for a particular data stream. Since memory is
   // very limited on an Arduino, we cannot parse and get all the
   // data points in memory. Instead, we use callbacks here: whenever
@@ -85,42 +105,69 @@ public:
   // response is only parsed when the HTTP status code is 200
   int readLocation(const char* feedId, location_read_callback callback,
                    void* context);
+
+  // Returns the cellular traffic of the last request from connecting to
+  // reading the response, including a request that had to be sent again.
+  // Traffic of other users of the radio in that time is included, and the
+  // counters stay 0 if the request went over another transport
+  mts::Cellular::DataUsage getRequestUsage();
 private:
   Client* _client;
   const char* _key;
   const char* _host;
   int _port;
-  NullPrint _null_print;
+  BodyPrint _body;
+  // Header lines that do not change between requests, sent in one write
+  uint8_t* _header;
+  int _headerLength;
+  // Set while the connection can be reused by the next request
+  bool _keepAlive;
+  // Set once a byte of the response to the current request was read
+  bool _responseStarted;
+  // Set while a request is sent again, so its deadline is not restarted
+  bool _retrying;
+  // Time allowed for a request and its response
+  int _timeout;
+  // Time since the current request started connecting
+  Timer _requestTimer;
+  // Cellular traffic counters when the current request started
+  mts::Cellular::DataUsage _usageMark;
+  // Cellular traffic of the last request
+  mts::Cellular::DataUsage _requestUsage;
 
-  // Writes the HTTP header part for updating a stream value
+  // Writes the HTTP header part for updating a stream value, the body
+  // length is written by _body once the body has been rendered
   void writeSendHeader(const char* feedId,
-                       const char* streamName,
-                       int contentLength);
-  // Writes HTTP header lines including M2X key, host, content
-  // type and content length(if the body exists)
-  void writeHttpHeader(int contentLength);
-  // Parses HTTP response header and return the content length.
-  // Note that this function does not parse all http headers, as long
-  // as the content length is found, this function will return
-  int readContentLength();
-  // Skips all HTTP response header part. Return minus value in case
-  // the connection is closed before we got all headers
-  int skipHttpHeader();
-  // Parses and returns the HTTP status code, note this function will
-  // return immediately once it gets the status code
-  int readStatusCode(bool closeClient);
-  // Waits for a certain string pattern in the HTTP header, and returns
-  // once the pattern is found. In the pattern, you can use '*' to denote
-  // any character
-  int waitForString(const char* str);
+                       const char* streamName);
+  // Writes HTTP header lines including the prebuilt M2X key and host
+  // lines and the content type (if the body exists). Without a body, which
+  // is a NULL contentType, the header is ended here, otherwise the body
+  // length has to end it
+  void writeHttpHeader(const char* contentType);
+  // Starts the request deadline and connects to the server unless the
+  // connection of the previous request can be reused. Returns false if no
+  // connection could be made in time, reused is set if the previous
+  // connection is used
+  bool open(bool& reused);
+  // Returns true if a request on a reused connection got no response
+  // because the server closed the connection before any response byte, so
+  // it has to be sent again on a new connection. A request that got a
+  // response that could not be parsed is not sent again
+  bool retry(int status, bool reused);
+  // Waits until response data is available. Returns E_OK, or E_DISCONNECTED
+  // or E_TIMEOUT if the request deadline passed first
+  int waitForData();
+  // Reads a whole response in one pass and returns its status code or a
+  // negative error. The body of a 200 response is parsed as JSON with cbs,
+  // if cbs is not NULL. Returns E_TIMEOUT once the request deadline passed
+  int readResponse(const jsonlite_parser_callbacks* cbs);
+  // Stores the cellular traffic since the current request started
+  void recordUsage();
+  // Keeps the connection for the next request if the server keeps it
+  // open, otherwise closes it
+  void finish();
   // Closes the connection
   void close();
-  // Parses JSON response of stream value API, and calls callback function
-  // once we get a data point
-  int readStreamValue(stream_value_read_callback callback, void* context);
-  // Parses JSON response of location API, and calls callback function once
-  // we get a data point
-  int readLocation(location_read_callback callback, void* context);
 };
 
 #endif  /* M2XStreamClient_h */
@@ -1,7 +1,6 @@
 #include "Print.h"
 #include "mbed.h"
 
-#include <stdio.h>
 #include <string.h>
 
 size_t Print::write(const uint8_t* buf, size_t size) {
@@ -25,16 +24,119 @@ size_t Print::print(int n) {
 }
 
 size_t Print::print(long n) {
-  char buf[8 * sizeof(long) + 1];
-  snprintf(buf, sizeof(buf), "%ld", n);
-  return print(buf);
+  // Formats from the last digit backwards, the unsigned value also covers
+  // LONG_MIN
+  char buf[3 * sizeof(long) + 2];
+  char* p = buf + sizeof(buf);
+  unsigned long u = (n < 0) ? -(unsigned long) n : (unsigned long) n;
+  do {
+    *--p = '0' + (u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (n < 0) {
+    *--p = '-';
+  }
+  return write((const uint8_t*) p, buf + sizeof(buf) - p);
 }
 
-// Digits are ignored for now
+// Powers of ten for the fraction digits, 9 digits still fit in 32 bits
+static const uint32_t kPow10[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+static const int kMaxDigits = 9;
+
+// Prints n with at most digits digits after the decimal point, dropping
+// trailing zeros. Formats without printf, which is slow and large without
+// an FPU. Values that do not fit 32 bits and values other than 0 that are
+// smaller than the last digit are printed with an exponent, like %g does
 size_t Print::print(double n, int digits) {
-  char buf[65];
-  snprintf(buf, sizeof(buf), "%g", n);
-  return print(buf);
+  if (n != n) {
+    return print("nan");
+  }
+  if (digits < 0) {
+    digits = 0;
+  } else if (digits > kMaxDigits) {
+    digits = kMaxDigits;
+  }
+
+  char buf[32];
+  char* p = buf;
+  if (n < 0) {
+    *p++ = '-';
+    n = -n;
+  }
+  if (n > 1.7976931348623157e308) {
+    strcpy(p, "inf");
+    return print(buf);
+  }
+  int exponent = 0;
+  if (n >= 4294967295.0) {
+    while (n >= 10) {
+      n /= 10;
+      exponent++;
+    }
+  } else if ((n > 0) && (n < 1.0 / kPow10[digits])) {
+    while (n < 1) {
+      n *= 10;
+      exponent--;
+    }
+  }
+
+  uint32_t integer = (uint32_t) n;
+  uint32_t fraction = (uint32_t) ((n - integer) * kPow10[digits] + 0.5);
+  if (fraction >= kPow10[digits]) {
+    // Rounding carried into the integer part
+    fraction -= kPow10[digits];
+    integer++;
+    if ((exponent != 0) && (integer == 10)) {
+      // Keeps the mantissa below 10
+      integer = 1;
+      exponent++;
+    }
+  }
+  if ((integer == 0) && (fraction == 0)) {
+    // Small negative values round to 0, not -0
+    p = buf;
+  }
+  while ((digits > 0) && (fraction % 10 == 0)) {
+    fraction /= 10;
+    digits--;
+  }
+
+  char* end = p + 10;
+  for (char* q = end; q != p;) {
+    *--q = '0' + (integer % 10);
+    integer /= 10;
+  }
+  // Drops the leading zeros, keeping at least one digit
+  char* first = p;
+  while ((first < end - 1) && (*first == '0')) {
+    first++;
+  }
+  memmove(p, first, end - first);
+  p += end - first;
+
+  if (digits > 0) {
+    *p++ = '.';
+    for (int i = digits - 1; i >= 0; i--) {
+      p[i] = '0' + (fraction % 10);
+      fraction /= 10;
+    }
+    p += digits;
+  }
+  if (exponent != 0) {
+    *p++ = 'e';
+    *p++ = (exponent > 0) ? '+' : '-';
+    if (exponent < 0) {
+      exponent = -exponent;
+    }
+    if (exponent >= 100) {
+      *p++ = '0' + exponent / 100;
+    }
+    *p++ = '0' + (exponent / 10) % 10;
+    *p++ = '0' + exponent % 10;
+  }
+  return write((const uint8_t*) buf, p - buf);
 }
 
 size_t Print::println(const char* s) {
@@ -0,0 +1,163 @@
+#include "ValueBatch.h"
+#include "M2XStreamClient.h"
+#include "BufferPrint.h"
+
+#include <jsonlite.h>
+#include <string.h>
+
+ValueBatch::ValueBatch() : _count(0),
+                           _bytes(0),
+                           _maxCount(kMaxValues),
+                           _maxAge(kDefaultMaxAge),
+                           _maxBytes(kDefaultMaxBytes) {
+}
+
+void ValueBatch::setFlushPolicy(int maxCount, int maxAge, int maxBytes) {
+  _maxCount = MIN(maxCount, kMaxValues);
+  _maxAge = maxAge;
+  _maxBytes = maxBytes;
+}
+
+bool ValueBatch::add(const char* streamName, const char* at,
+                     const char* value) {
+  if ((_count == kMaxValues) || (strlen(value) > kValueLength)) {
+    return false;
+  }
+  strcpy(_entries[_count].value, value);
+  return commit(streamName, at);
+}
+
+bool ValueBatch::add(const char* streamName, const char* at, double value) {
+  if (_count == kMaxValues) {
+    return false;
+  }
+  // Formatted in place, with the same precision as single values
+  BufferPrint print((uint8_t*) _entries[_count].value, kValueLength);
+  print.print(value, MAX_DOUBLE_DIGITS);
+  if (print.length() > kValueLength) {
+    return false;
+  }
+  _entries[_count].value[print.length()] = '\0';
+  return commit(streamName, at);
+}
+
+bool ValueBatch::add(const char* streamName, const char* at, long value) {
+  if (_count == kMaxValues) {
+    return false;
+  }
+  BufferPrint print((uint8_t*) _entries[_count].value, kValueLength);
+  print.print(value);
+  if (print.length() > kValueLength) {
+    return false;
+  }
+  _entries[_count].value[print.length()] = '\0';
+  return commit(streamName, at);
+}
+
+bool ValueBatch::add(const char* streamName, const char* at, int value) {
+  return add(streamName, at, (long) value);
+}
+
+bool ValueBatch::commit(const char* streamName, const char* at) {
+  Entry& entry = _entries[_count];
+  if (at == NULL) {
+    entry.at[0] = '\0';
+  } else if (strlen(at) > kTimestampLength) {
+    return false;
+  } else {
+    strcpy(entry.at, at);
+  }
+  entry.stream = streamName;
+
+  // Approximate JSON size: {"at":"...","value":"..."}, plus "name":[], for
+  // the first value of a stream
+  _bytes += strlen(entry.value) + 13;
+  if (entry.at[0] != '\0') {
+    _bytes += strlen(entry.at) + 8;
+  }
+  bool first = true;
+  for (int i = 0; i < _count; i++) {
+    if (strcmp(_entries[i].stream, streamName) == 0) {
+      first = false;
+      break;
+    }
+  }
+  if (first) {
+    _bytes += strlen(streamName) + 6;
+  }
+
+  if (_count == 0) {
+    // {"values":{}}
+    _bytes += 13;
+    _age.reset();
+    _age.start();
+  }
+  _count++;
+  return true;
+}
+
+bool ValueBatch::isDue() {
+  if (_count == 0) {
+    return false;
+  }
+  return ((_maxCount > 0) && (_count >= _maxCount)) ||
+         ((_maxAge > 0) && (_age.read_ms() >= _maxAge)) ||
+         ((_maxBytes > 0) && (_bytes >= _maxBytes));
+}
+
+void ValueBatch::clear() {
+  _count = 0;
+  _bytes = 0;
+  _age.stop();
+  _age.reset();
+}
+
+bool ValueBatch::build(char** data, size_t* size) {
+  if (_count == 0) {
+    return false;
+  }
+
+  // {"values": {"stream": [{"at": "...", "value": "..."}, ...], ...}}
+  jsonlite_builder builder = jsonlite_builder_init(5);
+  jsonlite_builder_object_begin(builder);
+  jsonlite_builder_key(builder, "values", 6);
+  jsonlite_builder_object_begin(builder);
+  for (int i = 0; i < _count; i++) {
+    // Each stream is written once, with all its values
+    const char* stream = _entries[i].stream;
+    bool written = false;
+    for (int j = 0; j < i; j++) {
+      if (strcmp(_entries[j].stream, stream) == 0) {
+        written = true;
+        break;
+      }
+    }
+    if (written) {
+      continue;
+    }
+
+    jsonlite_builder_key(builder, stream, strlen(stream));
+    jsonlite_builder_array_begin(builder);
+    for (int j = i; j < _count; j++) {
+      const Entry& entry = _entries[j];
+      if (strcmp(entry.stream, stream) != 0) {
+        continue;
+      }
+      jsonlite_builder_object_begin(builder);
+      if (entry.at[0] != '\0') {
+        jsonlite_builder_key(builder, "at", 2);
+        jsonlite_builder_string(builder, entry.at, strlen(entry.at));
+      }
+      jsonlite_builder_key(builder, "value", 5);
+      jsonlite_builder_string(builder, entry.value, strlen(entry.value));
+      jsonlite_builder_object_end(builder);
+    }
+    jsonlite_builder_array_end(builder);
+  }
+  jsonlite_builder_object_end(builder);
+  jsonlite_builder_object_end(builder);
+
+  jsonlite_result result = jsonlite_builder_data(builder, data, size);
+  jsonlite_builder_release(builder);
+  return result == jsonlite_result_ok;
+}
@@ -0,0 +1,77 @@
+#ifndef ValueBatch_h
+#define ValueBatch_h
+
+#include "mbed.h"
+
+#include <stddef.h>
+
+// Collects values for several streams of a feed, so they can be posted in
+// one request with M2XStreamClient::sendBatch instead of one request per
+// value. The flush policy decides when the batch is due: once it holds a
+// number of values, once its oldest value reaches an age, or once its JSON
+// body grows to a size, whichever comes first.
+//
+// Stream names are not copied, they must stay valid until the batch is
+// sent. Timestamps and values are copied.
+class ValueBatch {
+public:
+  static const int kMaxValues = 16;
+  // Longest timestamp, as in "2013-09-09T19:15:00.000Z"
+  static const int kTimestampLength = 24;
+  // Longest value once formatted
+  static const int kValueLength = 20;
+
+  static const int kDefaultMaxAge = 60000;
+  static const int kDefaultMaxBytes = 512;
+
+  ValueBatch();
+
+  // Sets the flush policy. maxCount is the number of values, up to
+  // kMaxValues, maxAge the age of the oldest value in milliseconds and
+  // maxBytes the approximate size of the JSON body. A limit of 0 or less
+  // is not checked. The defaults are kMaxValues, kDefaultMaxAge and
+  // kDefaultMaxBytes
+  void setFlushPolicy(int maxCount, int maxAge, int maxBytes);
+
+  // Adds a value for a stream. at is the timestamp of the value in ISO 8601
+  // format, or NULL to have the server use the time it receives the batch.
+  // Returns false if the batch is full or the timestamp or value is too long
+  bool add(const char* streamName, const char* at, const char* value);
+  bool add(const char* streamName, const char* at, double value);
+  bool add(const char* streamName, const char* at, long value);
+  bool add(const char* streamName, const char* at, int value);
+
+  // Returns true if the flush policy says the batch should be sent
+  bool isDue();
+  // Returns the number of values in the batch
+  int count() const { return _count; }
+  // Returns the approximate size of the JSON body
+  int bytes() const { return _bytes; }
+  // Removes all values
+  void clear();
+
+  // Builds the JSON body for the M2X batch values API with jsonlite. The
+  // data is allocated with malloc and has to be freed by the caller.
+  // Returns false if the batch is empty or could not be built
+  bool build(char** data, size_t* size);
+private:
+  struct Entry {
+    const char* stream;
+    char at[kTimestampLength + 1];
+    char value[kValueLength + 1];
+  };
+
+  // Adds the value in the scratch entry after _count
+  bool commit(const char* streamName, const char* at);
+
+  Entry _entries[kMaxValues];
+  int _count;
+  int _bytes;
+  int _maxCount;
+  int _maxAge;
+  int _maxBytes;
+  // Time since the oldest value was added
+  Timer _age;
+};
+
+#endif  /* ValueBatch_h */
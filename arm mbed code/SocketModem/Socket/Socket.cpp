@@ -20,8 +20,8 @@
 #include <cstring>
 #include "Transport.h"
 
-Socket::Socket() : _blocking(true), _timeout(1500) {
-    ip = Transport::getInstance();
+Socket::Socket() : _blocking(true), _timeout(1500), ip(NULL) {
+    //The transport is selected when the socket is connected
 }
 
 void Socket::set_blocking(bool blocking, unsigned int timeout) {
@@ -29,7 +29,17 @@ void Socket::set_blocking(bool blocking, unsigned int timeout) {
     _timeout = timeout;
 }
 
+int Socket::poll(int events, int timeout) {
+    if (ip == NULL) {
+        return -1;
+    }
+    return ip->poll(events, timeout);
+}
+
 int Socket::close() {
+    if (ip == NULL) {
+        return -1;
+    }
     return (ip->close()) ? 0 : -1;
 }
 
@@ -24,7 +24,7 @@
   */
 class Socket {
 public:
-    /** Socket
+    /** Socket, the transport is selected when the socket is connected
      */
     Socket();
     
@@ -35,6 +35,13 @@ public:
     */
     void set_blocking(bool blocking, unsigned int timeout=1500);
     
+    /** Wait for the socket to become readable, writeable or closed
+    \param events   the mts::IPStack::Event values to wait for, combined with a bitwise OR.
+    \param timeout  timeout in ms, 0 to only check and -1 to wait until an event occurs.
+    \return the events that are ready, 0 on timeout, -1 if the socket has no transport.
+    */
+    int poll(int events, int timeout);
+    
     /** Close the socket file descriptor
      */
     int close();
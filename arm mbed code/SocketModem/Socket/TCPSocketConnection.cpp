@@ -17,36 +17,82 @@
  */
 
 #include "TCPSocketConnection.h"
+#include "Transport.h"
 #include <algorithm>
 
-TCPSocketConnection::TCPSocketConnection()
+TCPSocketConnection::TCPSocketConnection() : _connecting(false)
 {
 }
 
 int TCPSocketConnection::connect(const char* host, const int port)
 {
+    //Route the connection to the transport that is best at this moment
+    ip = Transport::getInstance();
+    if (ip == NULL) {
+        return -1;
+    }
     if (!ip->open(host, port, mts::IPStack::TCP)) {
+        Transport::reportFailure(ip);
+        //Fail over once if another transport is available
+        mts::IPStack* backup = Transport::getInstance();
+        if (backup == NULL || backup == ip || !backup->open(host, port, mts::IPStack::TCP)) {
+            return -1;
+        }
+        ip = backup;
+    }
+    return 0;
+}
+
+int TCPSocketConnection::connect_async(const char* host, const int port)
+{
+    ip = Transport::getInstance();
+    if (ip == NULL) {
+        return -1;
+    }
+    if (!ip->startOpen(host, port, mts::IPStack::TCP)) {
+        Transport::reportFailure(ip);
         return -1;
     }
+    _connecting = true;
     return 0;
 }
 
+int TCPSocketConnection::connect_status(void)
+{
+    if (ip == NULL) {
+        return -1;
+    }
+    mts::IPStack::OpenState state = ip->checkOpen();
+    if (state == mts::IPStack::OPENING) {
+        return 0;
+    }
+    if (_connecting) {
+        _connecting = false;
+        if (state == mts::IPStack::OPEN_FAILED) {
+            Transport::reportFailure(ip);
+        }
+        _connected.call();
+    }
+    return (state == mts::IPStack::OPENED) ? 1 : -1;
+}
+
+void TCPSocketConnection::attach_connect(void (*fptr)(void))
+{
+    _connected.attach(fptr);
+}
+
 bool TCPSocketConnection::is_connected(void)
 {
-    return ip->isOpen();
+    return (ip != NULL) && ip->isOpen();
 }
 
 int TCPSocketConnection::send(char* data, int length)
 {
-    Timer tmr;
-
+    if (ip == NULL) {
+        return -1;
+    }
     if (!_blocking) {
-        tmr.start();
-        while (tmr.read_ms() < _timeout) {
-            if (ip->writeable())
-                break;
-        }
-        if (tmr.read_ms() >= _timeout) {
+        if (!(ip->poll(mts::IPStack::WRITEABLE, _timeout) & mts::IPStack::WRITEABLE)) {
             return -1;
         }
     }
@@ -56,6 +102,9 @@ int TCPSocketConnection::send(char* data, int length)
 // -1 if unsuccessful, else number of bytes written
 int TCPSocketConnection::send_all(char* data, int length)
 {
+    if (ip == NULL) {
+        return -1;
+    }
     if (_blocking) {
         return ip->write(data, length, -1);
     } else {
@@ -66,31 +115,54 @@ int TCPSocketConnection::send_all(char* data, int length)
 // -1 if unsuccessful, else number of bytes received
 int TCPSocketConnection::receive(char* data, int length)
 {
-    Timer tmr;
-    int time = -1;
-
-    if (!_blocking) {
-        tmr.start();
-        while (time < _timeout + 20) {
-            if (ip->readable()) {
-                break;
-            }
-            time = tmr.read_ms();
-        }
-        if (time >= _timeout + 20) {
-            return -1;
-        }
-    } else {
-        while(!ip->readable());
+    if (ip == NULL) {
+        return -1;
+    }
+    int ready = ip->poll(mts::IPStack::READABLE | mts::IPStack::CLOSED, receiveTimeout());
+    if (!(ready & mts::IPStack::READABLE)) {
+        return -1;
     }
 
     return ip->read(data, length, 0);
 }
 
 
+// -1 if unsuccessful, else number of bytes available at data
+int TCPSocketConnection::receive_view(const char*& data)
+{
+    if (ip == NULL) {
+        return -1;
+    }
+    int ready = ip->poll(mts::IPStack::READABLE | mts::IPStack::CLOSED, receiveTimeout());
+    if (!(ready & mts::IPStack::READABLE)) {
+        return -1;
+    }
+
+    return ip->peek(data);
+}
+
+int TCPSocketConnection::receiveTimeout()
+{
+    if (_blocking) {
+        return -1;
+    }
+    //A zero timeout only checks, the grace time is for waits that expire
+    return (_timeout == 0) ? 0 : _timeout + 20;
+}
+
+void TCPSocketConnection::consume(int length)
+{
+    if (ip != NULL) {
+        ip->consume(length);
+    }
+}
+
 // -1 if unsuccessful, else number of bytes received
 int TCPSocketConnection::receive_all(char* data, int length)
 {
+    if (ip == NULL) {
+        return -1;
+    }
     if (_blocking) {
         return ip->read(data, length, -1);
     } else {
@@ -19,6 +19,7 @@
 #ifndef TCPSOCKET_H
 #define TCPSOCKET_H
 
+#include "mbed.h"
 #include "Socket.h"
 #include "Endpoint.h"
 
@@ -39,6 +40,34 @@ public:
     */
     int connect(const char* host, const int port);
     
+    /** Starts connecting this TCP socket to the server without waiting for the
+    connection to be established. Use connect_status to complete the connection.
+    \param host The host to connect to. It can either be an IP Address or a hostname that will be resolved with DNS.
+    \param port The host's port to connect to.
+    \return 0 if the connection was started or is already established, -1 on failure.
+    */
+    int connect_async(const char* host, const int port);
+    
+    /** Checks the progress of a connection started with connect_async without
+    blocking. The attached callback is called once when the connection completes.
+    \return 1 if connected, 0 while connecting, -1 if the connection failed.
+    */
+    int connect_status(void);
+    
+    /** Attach a function that is called when a connection started with connect_async completes
+    \param fptr A pointer to the function to be called, use connect_status to get the result.
+    */
+    void attach_connect(void (*fptr)(void));
+    
+    /** Attach a member function that is called when a connection started with connect_async completes
+    \param tptr A pointer to the object to call the member function on.
+    \param mptr A pointer to the member function to be called, use connect_status to get the result.
+    */
+    template<typename T>
+    void attach_connect(T* tptr, void (T::*mptr)(void)) {
+        _connected.attach(tptr, mptr);
+    }
+    
     /** Check if the socket is connected
     \return true if connected, false otherwise.
     */
@@ -65,12 +94,30 @@ public:
      */
     int receive(char* data, int length);
     
+    /** Receive data from the remote host without copying it. The data is lent
+    from the transport's receive buffer and stays valid until consume is called.
+    \param data Set to point to the received data.
+    \return the number of bytes available at data on success (>=0) or -1 on failure
+    */
+    int receive_view(const char*& data);
+    
+    /** Remove data that was received with receive_view.
+    \param length The number of bytes to remove, at most the length returned by receive_view.
+    */
+    void consume(int length);
+    
     /** Receive all the data from the remote host.
     \param data The buffer in which to store the data received from the host.
     \param length The maximum length of the buffer.
     \return the number of received bytes on success (>=0) or -1 on failure
     */
     int receive_all(char* data, int length);
+
+private:
+    FunctionPointer _connected;
+    bool _connecting;
+
+    int receiveTimeout(); //Poll timeout of the receive methods, 0 only checks without waiting
 };
 
 #endif
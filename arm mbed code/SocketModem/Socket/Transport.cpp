@@ -19,15 +19,85 @@
 #include "Wifi.h"
 
 Transport::TransportType Transport::_type = Transport::NONE;
+Transport::TransportType Transport::_selected = Transport::NONE;
+bool Transport::_added[Transport::TRANSPORTS] = {false, false};
+int Transport::_cost[Transport::TRANSPORTS] = {20, 0};
+bool Transport::_failed[Transport::TRANSPORTS] = {false, false};
+Timer Transport::_failTimer[Transport::TRANSPORTS];
+RequestQueue Transport::_queue;
 
 void Transport::setTransport(TransportType type)
 {
     _type = type;
 }
 
+void Transport::addTransport(TransportType type, int cost)
+{
+    if (type != CELLULAR && type != WIFI) {
+        printf("[ERROR] Only CELLULAR and WIFI can be added.\n\r");
+        return;
+    }
+    _added[type] = true;
+    _cost[type] = cost;
+    _failed[type] = false;
+}
+
+void Transport::addTransport(TransportType type)
+{
+    addTransport(type, (type == WIFI) ? 0 : 20);
+}
+
+void Transport::removeTransport(TransportType type)
+{
+    if (type == CELLULAR || type == WIFI) {
+        _added[type] = false;
+    }
+}
+
+void Transport::reportFailure(IPStack* ip)
+{
+    for (int i = 0; i < TRANSPORTS; i++) {
+        if (_added[i] && getInstance((TransportType) i) == ip) {
+            printf("[WARNING] Transport %s failed, failing over.\n\r", (i == WIFI) ? "WIFI" : "CELLULAR");
+            _failed[i] = true;
+            _failTimer[i].reset();
+            _failTimer[i].start();
+        }
+    }
+}
+
 IPStack* Transport::getInstance()
 {
-    switch (_type) {
+    return getInstance(IPStack::TCP);
+}
+
+IPStack* Transport::getInstance(IPStack::Mode mode)
+{
+    _selected = (_type == AUTO) ? select(mode) : _type;
+    if (_selected == NONE && _type == AUTO) {
+        printf("[ERROR] No transport available, use addTransport method.\n\r");
+        return NULL;
+    }
+    if ((_selected == CELLULAR || _selected == WIFI) && !supports(_selected, mode)) {
+        printf("[ERROR] Transport does not support %s sockets.\n\r", (mode == IPStack::UDP) ? "UDP" : "TCP");
+        return NULL;
+    }
+    return getInstance(_selected);
+}
+
+Transport::TransportType Transport::getSelected()
+{
+    return _selected;
+}
+
+RequestQueue& Transport::getRequestQueue()
+{
+    return _queue;
+}
+
+IPStack* Transport::getInstance(TransportType type)
+{
+    switch (type) {
         case CELLULAR:
             return (IPStack*) Cellular::getInstance();
         case WIFI:
@@ -38,3 +108,77 @@ IPStack* Transport::getInstance()
     }
 }
 
+Transport::TransportType Transport::select(IPStack::Mode mode)
+{
+    //Rank the added transports that support the mode by score, skipping recent failures
+    TransportType order[TRANSPORTS];
+    int count = 0;
+    for (int i = 0; i < TRANSPORTS; i++) {
+        if (!_added[i] || !supports((TransportType) i, mode)) {
+            continue;
+        }
+        if (_failed[i] && _failTimer[i].read_ms() >= FAILURE_HOLDOFF) {
+            _failed[i] = false;
+            _failTimer[i].stop();
+        }
+        order[count++] = (TransportType) i;
+    }
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && getScore(order[j]) > getScore(order[j - 1]); j--) {
+            TransportType tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    //Use the best connected transport that has not failed recently, then any connected one.
+    //Asking a radio if it is connected costs command round trips, so the newest link
+    //samples are used first and the radios are only asked when no sample shows a link
+    for (int query = 0; query < 2; query++) {
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < count; i++) {
+                if ((pass == 0 && _failed[order[i]]) || (pass == 1 && !_failed[order[i]])) {
+                    continue;
+                }
+                if ((query == 0) ? isUp(order[i]) : getInstance(order[i])->isConnected()) {
+                    return order[i];
+                }
+            }
+        }
+    }
+
+    //Nothing is connected, let the socket bring up the best one
+    return (count > 0) ? order[0] : NONE;
+}
+
+bool Transport::supports(TransportType type, IPStack::Mode mode)
+{
+    //The WiFly module has no UDP socket mode
+    return mode == IPStack::TCP || type != WIFI;
+}
+
+bool Transport::isUp(TransportType type)
+{
+    LinkMonitor::Sample sample;
+    bool sampled;
+    if (type == CELLULAR) {
+        sampled = Cellular::getInstance()->getLinkMonitor().getSample(0, sample);
+    } else {
+        sampled = Wifi::getInstance()->getLinkMonitor().getSample(0, sample);
+    }
+    return sampled && sample.registered;
+}
+
+int Transport::getScore(TransportType type)
+{
+    int score;
+    if (type == CELLULAR) {
+        score = Cellular::getInstance()->getLinkMonitor().getScore();
+    } else {
+        score = Wifi::getInstance()->getLinkMonitor().getScore();
+    }
+    if (score < 0) {
+        score = 50;
+    }
+    return score - _cost[type];
+}
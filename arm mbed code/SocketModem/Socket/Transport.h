@@ -19,6 +19,7 @@
 
 #include "mbed.h"
 #include "IPStack.h"
+#include "MTSRequestQueue.h"
 
 using namespace mts;
 
@@ -35,15 +36,49 @@ class Transport
 public:
     ///An enumeration that holds the supported Transport Types.
     enum TransportType {
-        CELLULAR, WIFI, NONE
+        CELLULAR, WIFI, NONE, AUTO
     };
+
+    /// Time in milliseconds a transport is skipped by AUTO selection after a failure.
+    static const int FAILURE_HOLDOFF = 30000;
     
     /** This method allows you to set the transport to be used when creating other 
     * objects from the Socket folder like TCPSocketConnection and UDPSocket.  
+    * With AUTO the transport is chosen each time a socket connects, from the
+    * transports added with addTransport.
     *
     * @param type the type of underlying transport to be used. The default is NONE.
     */
     static void setTransport(TransportType type);
+
+    /** This method adds a transport that AUTO selection can use. The transport
+    * must be initialized before it is added. AUTO selection ranks the added
+    * transports by their LinkMonitor score, which reflects signal level, round
+    * trip and socket open times and probe loss, minus their cost. Transports
+    * that are not connected or failed within FAILURE_HOLDOFF are skipped unless
+    * no other transport is available. Whether a transport is connected is taken
+    * from its newest LinkMonitor sample, the radios are only asked when no
+    * sample shows a link.
+    *
+    * @param type the transport to add, CELLULAR or WIFI.
+    * @param cost the cost of using the transport in score points. The default
+    * is 0 for WIFI and 20 for CELLULAR, which prefers WiFi for similar links.
+    */
+    static void addTransport(TransportType type, int cost);
+    static void addTransport(TransportType type);
+
+    /** This method removes a transport from AUTO selection.
+    *
+    * @param type the transport to remove.
+    */
+    static void removeTransport(TransportType type);
+
+    /** This method is used to report that opening a socket on a transport
+    * failed, so that AUTO selection fails over to another transport.
+    *
+    * @param ip the transport that failed.
+    */
+    static void reportFailure(IPStack* ip);
     
     /** This method is used within the Socket class to get the appropraite transport
     * as an IPStack object.  In general you do not need to call this directly, but
@@ -52,9 +87,52 @@ public:
     * @returns a pointer to an object that implements IPStack.
     */
     static IPStack* getInstance();
+
+    /** This method is used within the Socket class to get the transport for a
+    * socket of the given mode. AUTO selection only considers the transports
+    * that support the mode, WIFI only supports TCP sockets.
+    *
+    * @param mode the mode of the socket, TCP or UDP.
+    * @returns a pointer to an object that implements IPStack, NULL if no
+    * transport supports the mode.
+    */
+    static IPStack* getInstance(IPStack::Mode mode);
+
+    /** This method returns the transport that was returned by the last call to
+    * getInstance.
+    *
+    * @returns the selected transport type, NONE if there is none.
+    */
+    static TransportType getSelected();
+
+    /** This method returns the queue for socket and AT command work that is
+    * started from an interrupt handler, which must never call the transports
+    * directly. Without an RTOS the main loop runs the requests by calling
+    * service, and the library must only be used from the main loop. With
+    * MTS_RTOS defined, start the queue once to run them on a dedicated I/O
+    * thread. Other threads may call the transports directly, each transport
+    * serialises its socket operations and command sequences with its own lock.
+    *
+    * @returns a reference to the shared RequestQueue.
+    */
+    static RequestQueue& getRequestQueue();
     
 private:
+    static const int TRANSPORTS = 2; // Number of transport types that can be selected
+
     static Transport::TransportType _type; // Member variable that holds the desired transport
+    static Transport::TransportType _selected; // Transport returned by the last getInstance call
+    static bool _added[TRANSPORTS]; // Specifies if a transport is used by AUTO selection
+    static int _cost[TRANSPORTS]; // Cost of each transport in score points
+    static bool _failed[TRANSPORTS]; // Specifies if a transport failed within the holdoff time
+    static Timer _failTimer[TRANSPORTS]; // Time since each transport last failed
+    static RequestQueue _queue; // Requests that are run by the owner of the transports
+
+    static IPStack* getInstance(TransportType type); // Gets the singleton of a transport type
+    static TransportType select(IPStack::Mode mode); // Chooses the best available transport for AUTO
+    static bool supports(TransportType type, IPStack::Mode mode); // Specifies if a transport can open sockets of a mode
+    static int getScore(TransportType type); // Link score minus cost, -1 if unknown treated as 50
+    static bool isUp(TransportType type); // Specifies if the newest link sample of a transport shows a link
 };
 
 #endif /* TRANSPORT_H */
\ No newline at end of file
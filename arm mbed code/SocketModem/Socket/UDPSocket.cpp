@@ -0,0 +1,85 @@
+/* Copyright (C) 2012 mbed.org, MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "UDPSocket.h"
+#include "Transport.h"
+#include <cstring>
+
+UDPSocket::UDPSocket() : _open(false)
+{
+}
+
+int UDPSocket::init(void)
+{
+    ip = Transport::getInstance(mts::IPStack::UDP);
+    return (ip != NULL) ? 0 : -1;
+}
+
+int UDPSocket::bind(int port)
+{
+    if (ip == NULL || port < 0 || !ip->bind(port)) {
+        return -1;
+    }
+    return 0;
+}
+
+// -1 if unsuccessful, else number of bytes written
+int UDPSocket::sendTo(Endpoint &remote, char *packet, int length)
+{
+    //Reopen the socket when the remote endpoint changes
+    bool same = _open && ip->isOpen() && remote.get_port() == _remote.get_port() &&
+                strcmp(remote.get_address(), _remote.get_address()) == 0;
+    if (!same) {
+        if (_open) {
+            ip->close();
+            _open = false;
+        }
+        //Only transports that support UDP are selected, so a failed open is a link failure
+        ip = Transport::getInstance(mts::IPStack::UDP);
+        if (ip == NULL) {
+            return -1;
+        }
+        if (!ip->open(remote.get_address(), remote.get_port(), mts::IPStack::UDP)) {
+            Transport::reportFailure(ip);
+            return -1;
+        }
+        _remote.set_address(remote.get_address(), remote.get_port());
+        _open = true;
+    }
+
+    if (_blocking) {
+        return ip->write(packet, length, -1);
+    } else {
+        return ip->write(packet, length, _timeout);
+    }
+}
+
+// -1 if unsuccessful, else number of bytes received
+int UDPSocket::receiveFrom(Endpoint &remote, char *buffer, int length)
+{
+    if (!_open) {
+        return -1;
+    }
+    int ready = ip->poll(mts::IPStack::READABLE | mts::IPStack::CLOSED, _blocking ? -1 : _timeout);
+    if (!(ready & mts::IPStack::READABLE)) {
+        return -1;
+    }
+
+    remote.set_address(_remote.get_address(), _remote.get_port());
+    return ip->read(buffer, length, 0);
+}
@@ -18,11 +18,29 @@
 #include "Cellular.h"
 #include "MTSText.h"
 #include "MTSSerial.h"
+#include "MTSDnsCache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 
 using namespace mts;
 
 Cellular* Cellular::instance = NULL;
 
+//Per radio timing and buffering profiles. The NA entry holds the conservative
+//defaults used until the radio has been identified. The model is the MultiTech
+//product name the radio reports in its ATI or AT+CGMM response.
+const Cellular::RadioProfile Cellular::radioProfiles[] = {
+    //radio       model        cmd   open   connect tx   rx   baud
+    { Vars::NA,   "",          1000, 30000, 120000, 64,  64,  115200 },
+    { Vars::G2,   "MTSMC-G2",  1000, 30000, 120000, 64,  64,  115200 },
+    { Vars::E1,   "MTSMC-E1",  1000, 25000, 90000,  64,  128, 115200 },
+    { Vars::EV2,  "MTSMC-EV2", 500,  20000, 60000,  128, 256, 230400 },
+    { Vars::H4,   "MTSMC-H4",  500,  20000, 60000,  128, 256, 230400 },
+    { Vars::EV3,  "MTSMC-EV3", 300,  15000, 45000,  256, 512, 460800 },
+    { Vars::H5,   "MTSMC-H5",  300,  15000, 45000,  256, 512, 921600 }
+};
+
 Cellular* Cellular::getInstance()
 {
     if(instance == NULL) {
@@ -43,6 +61,18 @@ Cellular::Cellular(MTSBufferedIO* io)
     , host_port(0)
     , dcd(NULL)
     , dtr(NULL)
+    , openState(OPEN_IDLE)
+    , openResolved(false)
+    , dnsQuery(true)
+    , rxEscaped(false)
+    , rxHeldStart(0)
+    , rxHeldLength(0)
+    , rxHeldPayload(false)
+    , radio(Vars::NA)
+    , profile(radioProfiles[0])
+    , lifetimeUsage()
+    , socketUsage()
+    , usagePersistInterval(0)
 {
 }
 
@@ -58,6 +88,7 @@ Cellular::~Cellular()
 
 bool Cellular::init(MTSBufferedIO* io, PinName DCD, PinName DTR)
 {
+    ScopedLock guard(lock);
     if (io == NULL) {
         return false;
     }
@@ -83,13 +114,102 @@ bool Cellular::init(MTSBufferedIO* io, PinName DCD, PinName DTR)
         dtr->write(0);
     }
     instance->io = io;
+    dnsQuery = true;
+
+    if (test() != SUCCESS) {
+        return false;
+    }
+
+    //Identify the radio so that its timing profile can be used from now on
+    radio = detectRadio();
+    setRadioProfile(getRadioProfile(radio));
+    printf("[INFO] Radio type: %s\r\n", getRadioNames(radio).c_str());
+    return true;
+}
+
+Vars::Radio Cellular::detectRadio()
+{
+    //ATI reports the product name, AT+CGMM the model of the radio
+    std::string response = sendCommand("ATI", profile.commandTimeout);
+    response.append(sendCommand("AT+CGMM", profile.commandTimeout));
+
+    const int count = sizeof(radioProfiles) / sizeof(radioProfiles[0]);
+    for (int i = 1; i < count; i++) {
+        //The name must not continue with another letter or digit, like MTSMC-H5 in MTSMC-H5X
+        size_t length = strlen(radioProfiles[i].model);
+        size_t found = response.find(radioProfiles[i].model);
+        while (found != std::string::npos) {
+            size_t end = found + length;
+            if (end == response.size() || !isalnum((unsigned char) response[end])) {
+                return radioProfiles[i].radio;
+            }
+            found = response.find(radioProfiles[i].model, end);
+        }
+    }
+    printf("[WARNING] Unable to identify radio type from [%s], using default profile\r\n", response.c_str());
+    return Vars::NA;
+}
+
+std::string Cellular::lookupHost(const std::string& url)
+{
+    if(!dnsQuery) {
+        return "";
+    }
+
+    //The response has the form #QDNS: "<url>","<address>"
+    std::string response = sendCommand("AT#QDNS=\"" + url + "\"", DNS_TIMEOUT);
+    size_t start = response.find("#QDNS:");
+    if(start == string::npos) {
+        if(response.find("ERROR") != string::npos) {
+            printf("[WARNING] Radio does not resolve host names, DNS cache not used\r\n");
+            dnsQuery = false;
+        }
+        return "";
+    }
+    start = response.find("\",\"", start);
+    size_t stop = (start == string::npos) ? string::npos : response.find('"', start + 3);
+    if(stop == string::npos) {
+        printf("[WARNING] Failed to resolve URL [%s]\r\n", url.c_str());
+        return "";
+    }
+    std::string ip = response.substr(start + 3, stop - start - 3);
+    if(Text::split(ip, '.').size() != 4) {
+        printf("[WARNING] Failed to resolve URL [%s]\r\n", url.c_str());
+        return "";
+    }
+    return ip;
+}
+
+Vars::Radio Cellular::getRadioType()
+{
+    return radio;
+}
+
+const Cellular::RadioProfile& Cellular::getRadioProfile(Vars::Radio type)
+{
+    const int count = sizeof(radioProfiles) / sizeof(radioProfiles[0]);
+    for (int i = 0; i < count; i++) {
+        if (radioProfiles[i].radio == type) {
+            return radioProfiles[i];
+        }
+    }
+    return radioProfiles[0];
+}
 
-    return (test() == SUCCESS);
+const Cellular::RadioProfile& Cellular::getRadioProfile()
+{
+    return profile;
+}
+
+void Cellular::setRadioProfile(const RadioProfile& profile)
+{
+    this->profile = profile;
 }
 
 
 bool Cellular::connect()
 {
+    ScopedLock guard(lock);
     //Check if socket is open
     if(socketOpened) {
         return true;
@@ -129,7 +249,7 @@ bool Cellular::connect()
 
     //AT#CONNECTIONSTART: Make a PPP connection
     printf("[DEBUG] Making PPP Connection Attempt. APN[%s]\r\n", apn.c_str());
-    std::string pppResult = sendCommand("AT#CONNECTIONSTART", 120000);
+    std::string pppResult = sendCommand("AT#CONNECTIONSTART", profile.connectTimeout);
     std::vector<std::string> parts = Text::split(pppResult, "\r\n");
 
     if(pppResult.find("Ok_Info_GprsActivation") != std::string::npos) {
@@ -148,6 +268,7 @@ bool Cellular::connect()
 
 void Cellular::disconnect()
 {
+    ScopedLock guard(lock);
     //AT#CONNECTIONSTOP: Close a PPP connection
     printf("[DEBUG] Closing PPP Connection\r\n");
 
@@ -167,6 +288,7 @@ void Cellular::disconnect()
 
 bool Cellular::isConnected()
 {
+    ScopedLock guard(lock);
     //1) Check if APN was set
     if(apn.size() == 0) {
         printf("[DEBUG] APN is not set\r\n");
@@ -219,8 +341,22 @@ bool Cellular::bind(unsigned int port)
 
 bool Cellular::open(const std::string& address, unsigned int port, Mode mode)
 {
+    ScopedLock guard(lock);
+    if(!startOpen(address, port, mode)) {
+        return false;
+    }
+    while(checkOpen() == OPENING) {
+        io->waitReadable(100);
+    }
+    return socketOpened;
+}
+
+bool Cellular::startOpen(const std::string& address, unsigned int port, Mode mode)
+{
+    ScopedLock guard(lock);
     char buffer[256] = {0};
     Code portCode, addressCode;
+    openState = OPEN_FAILED;
 
     //1) Check that we do not have a live connection up
     if(socketOpened) {
@@ -235,6 +371,7 @@ bool Cellular::open(const std::string& address, unsigned int port, Mode mode)
         }
 
         printf("[DEBUG] Socket already opened\r\n");
+        openState = OPENED;
         return true;
     }
 
@@ -259,33 +396,53 @@ bool Cellular::open(const std::string& address, unsigned int port, Mode mode)
     if(local_port != 0) {
         //Attempt to set local port
         sprintf(buffer, "AT#OUTPORT=%d", local_port);
-        Code code = sendBasicCommand(buffer, 1000);
+        Code code = sendBasicCommand(buffer, profile.commandTimeout);
         if(code != SUCCESS) {
             printf("[WARNING] Unable to set local port (%d) [%d]\r\n", local_port, (int) code);
         }
     }
 
+    //Use a cached resolution of a host name so the radio does not have to look it up,
+    //the radio resolves the name itself if it can not be resolved here
+    std::string server = address;
+    std::string cached;
+    bool resolved = false;
+    if(Text::split(address, '.').size() != 4) {
+        if(DnsCache::getInstance()->lookup(address, cached) == DnsCache::HIT) {
+            resolved = true;
+        } else {
+            cached = lookupHost(address);
+            if(cached.size() != 0) {
+                DnsCache::getInstance()->add(address, cached);
+                resolved = true;
+            }
+        }
+    }
+    if(resolved) {
+        server = cached;
+    }
+
     //Set TCP/UDP parameters
     if(mode == TCP) {
         if(socketCloseable) {
-            Code code = sendBasicCommand("AT#DLEMODE=1,1", 1000);
+            Code code = sendBasicCommand("AT#DLEMODE=1,1", profile.commandTimeout);
             if(code != SUCCESS) {
                 printf("[WARNING] Unable to set socket closeable [%d]\r\n", (int) code);
             }
         }
         sprintf(buffer, "AT#TCPPORT=1,%d", port);
-        portCode = sendBasicCommand(buffer, 1000);
-        addressCode = sendBasicCommand("AT#TCPSERV=1,\"" + address + "\"", 1000);
+        portCode = sendBasicCommand(buffer, profile.commandTimeout);
+        addressCode = sendBasicCommand("AT#TCPSERV=1,\"" + server + "\"", CONTEXT_TIMEOUT);
     } else {
         if(socketCloseable) {
-            Code code = sendBasicCommand("AT#UDPDLEMODE=1", 1000);
+            Code code = sendBasicCommand("AT#UDPDLEMODE=1", profile.commandTimeout);
             if(code != SUCCESS) {
                 printf("[WARNING] Unable to set socket closeable [%d]\r\n", (int) code);
             }
         }
         sprintf(buffer, "AT#UDPPORT=%d", port);
-        portCode = sendBasicCommand(buffer, 1000);
-        addressCode = sendBasicCommand("AT#UDPSERV=\"" + address + "\"", 1000);
+        portCode = sendBasicCommand(buffer, profile.commandTimeout);
+        addressCode = sendBasicCommand("AT#UDPSERV=\"" + server + "\"", CONTEXT_TIMEOUT);
     }
 
     if(portCode == SUCCESS) {
@@ -301,31 +458,91 @@ bool Cellular::open(const std::string& address, unsigned int port, Mode mode)
     }
 
     // Try and Connect
-    std::string sMode;
-    std::string sOpenSocketCmd;
+    std::string command;
     if(mode == TCP) {
-        sOpenSocketCmd = "AT#OTCP=1";
-        sMode = "TCP";
+        command = "AT#OTCP=1";
     } else {
-        sOpenSocketCmd = "AT#OUDP";
-        sMode = "UDP";
+        command = "AT#OUDP";
+    }
+
+    //Send the open command without waiting, checkOpen processes the response
+    io->rxClear();
+    io->txClear();
+    rxHeldLength = 0;
+    if(io->write(command.data(), command.size(), profile.commandTimeout) != command.size() ||
+            io->write(CR, profile.commandTimeout) != 1) {
+        printf("[ERROR] failed to send command to radio within %d milliseconds\r\n", profile.commandTimeout);
+        return false;
+    }
+    DataUsage usage = DataUsage();
+    usage.commandTx = command.size() + 1;
+    addUsage(usage);
+
+    this->mode = mode;
+    openAddress = address;
+    openResolved = resolved;
+    openResponse = "";
+    openTimer.reset();
+    openTimer.start();
+    openState = OPENING;
+    return true;
+}
+
+IPStack::OpenState Cellular::checkOpen()
+{
+    ScopedLock guard(lock);
+    if(openState != OPENING) {
+        return openState;
+    }
+
+    //Read one byte at a time so no socket data after the response is consumed
+    char byte;
+    DataUsage usage = DataUsage();
+    while(io->read(byte) == 1) {
+        openResponse += byte;
+        usage.commandRx++;
+        if(byte == '\n' && (openResponse.find("Ok_Info_WaitingForData") != string::npos ||
+                             openResponse.find("ERROR") != string::npos ||
+                             openResponse.find("NO CARRIER") != string::npos)) {
+            break;
+        }
+    }
+    addUsage(usage);
+
+    bool opened = openResponse.find("Ok_Info_WaitingForData") != string::npos;
+    if(!opened && openResponse.find("ERROR") == string::npos &&
+            openResponse.find("NO CARRIER") == string::npos &&
+            openTimer.read_ms() < static_cast<int>(profile.socketOpenTimeout)) {
+        return OPENING;
     }
 
-    string response = sendCommand(sOpenSocketCmd, 30000);
-    if (response.find("Ok_Info_WaitingForData") != string::npos) {
-        printf("[INFO] Opened %s Socket [%s:%d]\r\n", sMode.c_str(), address.c_str(), port);
+    std::string sMode = (mode == TCP) ? "TCP" : "UDP";
+    if (opened) {
+        printf("[INFO] Opened %s Socket [%s:%d]\r\n", sMode.c_str(), openAddress.c_str(), host_port);
         socketOpened = true;
+        socketUsage = DataUsage();
     } else {
-        printf("[WARNING] Unable to open %s Socket [%s:%d]\r\n", sMode.c_str(),  address.c_str(), port);
+        printf("[WARNING] Unable to open %s Socket [%s:%d]\r\n", sMode.c_str(), openAddress.c_str(), host_port);
         socketOpened = false;
+        if(openResolved) {
+            //The cached address may be stale, let the radio resolve it next time
+            DnsCache::getInstance()->remove(openAddress);
+        }
+    }
+    if(mode == TCP) {
+        //TCP open time includes the handshake, record it as a round trip sample
+        linkMonitor.addRtt(socketOpened ? openTimer.read_ms() : -1);
     }
+    openTimer.stop();
 
-    return socketOpened;
+    openState = socketOpened ? OPENED : OPEN_FAILED;
+    return openState;
 }
 
 bool Cellular::isOpen()
 {
-    if(io->readable()) {
+    ScopedLock guard(lock);
+    if(io->readable() || rxHeldLength > 0) {
         printf("[DEBUG] Assuming open, data available to read.\n\r");
         return true;
     }
@@ -334,6 +551,7 @@ bool Cellular::isOpen()
 
 bool Cellular::close()
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return false;
@@ -369,79 +587,179 @@ bool Cellular::close()
 
     io->rxClear();
     io->txClear();
+    rxHeldLength = 0;
 
     socketOpened = false;
+    openState = OPEN_IDLE;
+    printf("[DEBUG] Socket usage: payload Tx[%lu] Rx[%lu] escape Tx[%lu] Rx[%lu]\r\n",
+           socketUsage.payloadTx, socketUsage.payloadRx, socketUsage.escapeTx, socketUsage.escapeRx);
     return true;
 }
 
 int Cellular::read(char* data, int max, int timeout)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return -1;
     }
 
     //Check that nothing is in the rx buffer
-    if(!socketOpened && !io->readable()) {
+    if(!socketOpened && !io->readable() && rxHeldLength == 0) {
         printf("[ERROR] Socket is not open\r\n");
         return -1;
     }
 
+    //Copy out of peek so escapes, held bytes and socket closed messages are
+    //handled the same way for both, also when they are split across calls
+    Timer tmr;
+    tmr.start();
     int bytesRead = 0;
+    while(bytesRead < max) {
+        const char* view;
+        int size = peek(view);
+        if(size > 0) {
+            size = std::min(size, max - bytesRead);
+            memcpy(data + bytesRead, view, size);
+            consume(size);
+            bytesRead += size;
+            continue;
+        }
+        if(size < 0 || !socketOpened || (timeout >= 0 && tmr.read_ms() >= timeout)) {
+            break;
+        }
+        io->waitReadable((timeout < 0) ? -1 : timeout - tmr.read_ms());
+    }
+    return bytesRead;
+}
 
-    if(timeout >= 0) {
-        bytesRead = io->read(data, max, static_cast<unsigned int>(timeout));
-    } else {
-        bytesRead = io->read(data, max);
-    }
-
-    if(bytesRead > 0 && socketCloseable) {
-        //Remove escape characters
-        int index = 0;
-        bool escapeFlag = false;
-        for(int i = 0; i < bytesRead; i++) {
-            if(data[i] == DLE || data[i] == ETX) {
-                if(escapeFlag == true) {
-                    //This character has been escaped
-                    escapeFlag = false;
-                } else if(data[bytesRead] == DLE) {
-                    //Found escape character
-                    escapeFlag = true;
-                    continue;
-                } else {
-                    //ETX sent without escape -> Socket closed
-                    printf("[INFO] Read ETX character without DLE escape. Socket closed\r\n");
-                    socketOpened = false;
-                    continue;
-                }
-            }
+int Cellular::peek(const char*& data)
+{
+    ScopedLock guard(lock);
+    if(io == NULL) {
+        printf("[ERROR] MTSBufferedIO not set\r\n");
+        return -1;
+    }
+    if(!socketOpened && !io->readable() && rxHeldLength == 0) {
+        return -1;
+    }
 
-            if(index != i) {
-                data[index] = data[i];
-            }
-            index++;
+    static const char closedMessage[] = "Ok_Info_SocketClosed";
+    const int closedLength = sizeof(closedMessage) - 1;
+    while(true) {
+        if(rxHeldLength > 0 && rxHeldPayload) {
+            data = rxHeld + rxHeldStart;
+            return rxHeldLength;
         }
-        bytesRead = index;
-    }
 
-    //Scan for socket closed message
-    for(size_t i = 0; i < bytesRead; i++) {
-        if(data[i] == 'O') {
-            if(strstr(&data[i], "Ok_Info_SocketClosed")) {
+        int size = io->peek(data);
+        if(rxHeldLength > 0) {
+            //Continue matching a socket closed message that the ring wrap split
+            int matched = 0;
+            while(matched < size && rxHeldLength + matched < closedLength &&
+                    data[matched] == closedMessage[rxHeldLength + matched]) {
+                matched++;
+            }
+            if(rxHeldLength + matched == closedLength) {
                 printf("[INFO] Found socket closed message. Socket closed\r\n");
-                //Close socket and Cut Off End of Message
+                io->consume(matched);
+                rxHeldLength = 0;
+                rxEscaped = false;
                 socketOpened = false;
-                data[i] = '\0';
-                bytesRead = i;
-                break;
+                continue;
+            }
+            if(matched == size && socketOpened) {
+                //The rest of the message has not arrived yet
+                return 0;
             }
+            rxHeldPayload = true;
+            continue;
+        }
+        if(size == 0) {
+            return socketOpened ? 0 : -1;
         }
+
+        //Remove escape characters at the front, the view ends before the next one
+        int length = size;
+        if(socketCloseable) {
+            if(!rxEscaped && data[0] == DLE) {
+                io->consume(1);
+                rxEscaped = true;
+                DataUsage usage = DataUsage();
+                usage.escapeRx = 1;
+                addUsage(usage);
+                continue;
+            }
+            if(!rxEscaped && data[0] == ETX) {
+                printf("[INFO] Read ETX character without DLE escape. Socket closed\r\n");
+                io->consume(1);
+                socketOpened = false;
+                continue;
+            }
+            length = 1;
+            while(length < size && data[length] != DLE && data[length] != ETX) {
+                length++;
+            }
+        }
+
+        //Cut the view off at a socket closed message
+        const char* closed = std::search(data, data + length, closedMessage, closedMessage + closedLength);
+        if(closed == data && length >= closedLength) {
+            printf("[INFO] Found socket closed message. Socket closed\r\n");
+            io->consume(closedLength);
+            rxEscaped = false;
+            socketOpened = false;
+            continue;
+        }
+        if(closed != data + length || length < size) {
+            return closed - data;
+        }
+
+        //Hold back the start of a socket closed message at the end of the view
+        int partial = std::min(length, closedLength - 1);
+        while(partial > 0 && memcmp(data + length - partial, closedMessage, partial) != 0) {
+            partial--;
+        }
+        if(partial < length) {
+            return length - partial;
+        }
+        if(io->readable() > size) {
+            //The rest is past the ring wrap, keep the start to compare it with
+            memcpy(rxHeld, data, partial);
+            io->consume(partial);
+            rxHeldStart = 0;
+            rxHeldLength = partial;
+            rxHeldPayload = false;
+            continue;
+        }
+        //Wait for the rest of the message unless the socket closed already
+        return socketOpened ? 0 : length;
     }
-    return bytesRead;
+}
+
+void Cellular::consume(int length)
+{
+    ScopedLock guard(lock);
+    if(io == NULL || length <= 0) {
+        return;
+    }
+    if(rxHeldLength > 0) {
+        length = std::min(length, rxHeldLength);
+        rxHeldStart += length;
+        rxHeldLength -= length;
+    } else {
+        length = io->consume(length);
+    }
+    rxEscaped = false;
+
+    DataUsage usage = DataUsage();
+    usage.payloadRx = length;
+    addUsage(usage);
 }
 
 int Cellular::write(const char* data, int length, int timeout)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return -1;
@@ -466,6 +784,7 @@ int Cellular::write(const char* data, int length, int timeout)
     }
 
     int bytesWritten = 0;
+    int retries = 0;
     if(timeout >= 0) {
         Timer tmr;
         tmr.start();
@@ -488,6 +807,7 @@ int Cellular::write(const char* data, int length, int timeout)
                             }
                         } else {
                             //Unable to write escape character, try again next round
+                            retries++;
                             wait(0.05);
                         }
                     } else {
@@ -505,31 +825,43 @@ int Cellular::write(const char* data, int length, int timeout)
             }
         } while (tmr.read_ms() <= timeout && bytesWritten < length);
     } else {
-        for(int i = 0; i < vSpecial.size(); i++) {
+        bool failed = false;
+        for(; specialWritten < vSpecial.size(); specialWritten++) {
             //Write up to the special character, then write the special character
-            int size = vSpecial[i] - bytesWritten;
+            int size = vSpecial[specialWritten] - bytesWritten;
             int currentWritten = io->write(&data[bytesWritten], size);
             bytesWritten += currentWritten;
             if(currentWritten != size) {
                 //Failed to write up to the special character.
-                return bytesWritten;
+                failed = true;
+                break;
             }
             if(io->write(DLE) && io->write(data[bytesWritten])) {
                 bytesWritten++;
             } else {
                 //Failed to write the special character.
-                return bytesWritten;
+                failed = true;
+                break;
             }
         }
 
-        bytesWritten = io->write(&data[bytesWritten], length - bytesWritten);
+        if(!failed) {
+            bytesWritten += io->write(&data[bytesWritten], length - bytesWritten);
+        }
     }
 
+    DataUsage usage = DataUsage();
+    usage.payloadTx = bytesWritten;
+    usage.escapeTx = specialWritten;
+    usage.retries = retries;
+    addUsage(usage);
+
     return bytesWritten;
 }
 
 unsigned int Cellular::readable()
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[WARNING] MTSBufferedIO not set\r\n");
         return 0;
@@ -543,6 +875,7 @@ unsigned int Cellular::readable()
 
 unsigned int Cellular::writeable()
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[WARNING] MTSBufferedIO not set\r\n");
         return 0;
@@ -555,8 +888,43 @@ unsigned int Cellular::writeable()
     return io->writeable();
 }
 
+int Cellular::poll(int events, int timeoutMillis)
+{
+    if(io == NULL) {
+        printf("[ERROR] MTSBufferedIO not set\r\n");
+        return 0;
+    }
+
+    Timer tmr;
+    tmr.start();
+    while(true) {
+        lock.acquire();
+        int ready = 0;
+        //Held bytes are readable once it is known they are not a socket closed message
+        int readable = io->readable() + ((rxHeldPayload || !socketOpened) ? rxHeldLength : 0);
+        if((events & READABLE) && readable) {
+            ready |= READABLE;
+        }
+        if((events & WRITEABLE) && socketOpened && io->writeable()) {
+            ready |= WRITEABLE;
+        }
+        if((events & CLOSED) && !socketOpened && !readable) {
+            ready |= CLOSED;
+        }
+        lock.release();
+        int elapsed = tmr.read_ms();
+        if(ready != 0 || (timeoutMillis >= 0 && elapsed >= timeoutMillis)) {
+            return ready;
+        }
+        //Only received data or a close marker in it can change the state. The
+        //lock is not held while sleeping, so other threads can use the radio
+        io->waitReadable((timeoutMillis < 0) ? -1 : timeoutMillis - elapsed);
+    }
+}
+
 void Cellular::reset()
 {
+    ScopedLock guard(lock);
     disconnect();
     Code code = sendBasicCommand("AT#RESET=0", 10000);
     if(code != SUCCESS) {
@@ -573,17 +941,19 @@ std::string Cellular::getDeviceIP()
 
 Code Cellular::test()
 {
+    ScopedLock guard(lock);
     bool basicRadioComms = false;
     Code code;
     Timer tmr;
     tmr.start();
     do {
         printf("[DEBUG] Attempting basic radio communication\r\n");
-        code = sendBasicCommand("AT", 1000);
+        code = sendBasicCommand("AT", profile.commandTimeout);
         if(code == SUCCESS) {
             basicRadioComms = true;
             break;
         } else {
+            countRetry();
             wait(1);
         }
     } while(tmr.read() < 15);
@@ -600,10 +970,10 @@ Code Cellular::echo(bool state)
 {
     Code code;
     if (state) {
-        code = sendBasicCommand("ATE0", 1000);
+        code = sendBasicCommand("ATE0", profile.commandTimeout);
         echoMode = (code == SUCCESS) ? false : echoMode;
     } else {
-        code = sendBasicCommand("ATE1", 1000);
+        code = sendBasicCommand("ATE1", profile.commandTimeout);
         echoMode = (code == SUCCESS) ? true : echoMode;
     }
     return code;
@@ -611,7 +981,7 @@ Code Cellular::echo(bool state)
 
 int Cellular::getSignalStrength()
 {
-    string response = sendCommand("AT+CSQ", 1000);
+    string response = sendCommand("AT+CSQ", profile.commandTimeout);
     if (response.find("OK") == string::npos) {
         return -1;
     }
@@ -625,6 +995,7 @@ int Cellular::getSignalStrength()
 
 Cellular::Registration Cellular::getRegistration()
 {
+    ScopedLock guard(lock);
     string response = sendCommand("AT+CREG?", 5000);
     if (response.find("OK") == string::npos) {
         return UNKNOWN;
@@ -653,7 +1024,7 @@ Cellular::Registration Cellular::getRegistration()
 
 Code Cellular::setApn(const std::string& apn)
 {
-    Code code = sendBasicCommand("AT#APNSERV=\"" + apn + "\"", 1000);
+    Code code = sendBasicCommand("AT#APNSERV=\"" + apn + "\"", CONTEXT_TIMEOUT);
     if (code != SUCCESS) {
         return code;
     }
@@ -664,30 +1035,39 @@ Code Cellular::setApn(const std::string& apn)
 
 Code Cellular::setDns(const std::string& primary, const std::string& secondary)
 {
-    return sendBasicCommand("AT#DNS=1," + primary + "," + secondary, 1000);
+    return sendBasicCommand("AT#DNS=1," + primary + "," + secondary, CONTEXT_TIMEOUT);
 }
 
-bool Cellular::ping(const std::string& address)
+bool Cellular::configurePing(const std::string& address)
 {
     char buffer[256] = {0};
     Code code;
 
-    code = sendBasicCommand("AT#PINGREMOTE=\"" + address + "\"", 1000);
+    code = sendBasicCommand("AT#PINGREMOTE=\"" + address + "\"", CONTEXT_TIMEOUT);
     if (code != SUCCESS) {
         return false;
     }
 
     sprintf(buffer, "AT#PINGNUM=%d", 1);
-    code = sendBasicCommand(buffer , 1000);
+    code = sendBasicCommand(buffer , profile.commandTimeout);
     if (code != SUCCESS) {
         return false;
     }
 
     sprintf(buffer, "AT#PINGDELAY=%d", PINGDELAY);
-    code = sendBasicCommand(buffer , 1000);
+    code = sendBasicCommand(buffer , profile.commandTimeout);
     if (code != SUCCESS) {
         return false;
     }
+    return true;
+}
+
+bool Cellular::ping(const std::string& address)
+{
+    ScopedLock guard(lock);
+    if (!configurePing(address)) {
+        return false;
+    }
 
     std::string response;
     for (int i = 0; i < PINGNUM; i++) {
@@ -695,12 +1075,59 @@ bool Cellular::ping(const std::string& address)
         if (response.find("alive") != std::string::npos) {
             return true;
         }
+        countRetry();
     }
     return false;
 }
 
+int Cellular::getPingTime(const std::string& address)
+{
+    ScopedLock guard(lock);
+    if (!configurePing(address)) {
+        return -1;
+    }
+
+    Timer tmr;
+    tmr.start();
+    std::string response = sendCommand("AT#PING", PINGDELAY * 1000);
+    if (response.find("alive") == std::string::npos) {
+        return -1;
+    }
+    return tmr.read_ms();
+}
+
+bool Cellular::updateLinkQuality(const std::string& address, bool force)
+{
+    ScopedLock guard(lock);
+    if (!force && !linkMonitor.isDue()) {
+        return false;
+    }
+    if (io == NULL || socketOpened) {
+        return false;
+    }
+
+    Registration registration = getRegistration();
+    bool registered = (registration == REGISTERED || registration == ROAMING);
+    int signal = LinkMonitor::csqToSignal(getSignalStrength());
+
+    int rtt = -1;
+    bool probed = registered && pppConnected;
+    if (probed) {
+        rtt = getPingTime(address);
+    }
+
+    linkMonitor.addSample(signal, rtt, probed, registered);
+    return true;
+}
+
+LinkMonitor& Cellular::getLinkMonitor()
+{
+    return linkMonitor;
+}
+
 Code Cellular::setSocketCloseable(bool enabled)
 {
+    ScopedLock guard(lock);
     if(socketCloseable == enabled) {
         return SUCCESS;
     }
@@ -722,19 +1149,20 @@ Code Cellular::sendSMS(const Sms& sms)
 
 Code Cellular::sendSMS(const std::string& phoneNumber, const std::string& message)
 {
-    Code code = sendBasicCommand("AT+CMGF=1", 1000);
+    ScopedLock guard(lock);
+    Code code = sendBasicCommand("AT+CMGF=1", SMS_TIMEOUT);
     if (code != SUCCESS) {
         return code;
     }
     string cmd = "AT+CMGS=\"+";
     cmd.append(phoneNumber);
     cmd.append("\"");
-    string response1 = sendCommand(cmd, 1000);
+    string response1 = sendCommand(cmd, SMS_TIMEOUT);
     if (response1.find('>') == string::npos) {
         return NO_RESPONSE;
     }
     wait(.2);
-    string  response2 = sendCommand(message, 4000, CTRL_Z);
+    string  response2 = sendCommand(message, SMS_TIMEOUT, CTRL_Z);
     printf("SMS Response: %s\r\n", response2.c_str());
     if (response2.find("+CMGS:") == string::npos) {
         return FAILURE;
@@ -744,9 +1172,10 @@ Code Cellular::sendSMS(const std::string& phoneNumber, const std::string& messag
 
 std::vector<Cellular::Sms> Cellular::getReceivedSms()
 {
+    ScopedLock guard(lock);
     int smsNumber = 0;
     std::vector<Sms> vSms;
-    std::string received = sendCommand("AT+CMGL=\"ALL\"", 4000);
+    std::string received = sendCommand("AT+CMGL=\"ALL\"", SMS_TIMEOUT);
     size_t pos = received.find("+CMGL: ");
 
     while (pos != std::string::npos) {
@@ -797,12 +1226,12 @@ std::vector<Cellular::Sms> Cellular::getReceivedSms()
 
 Code Cellular::deleteOnlyReceivedReadSms()
 {
-    return sendBasicCommand("AT+CMGD=1,1", 1000);
+    return sendBasicCommand("AT+CMGD=1,1", SMS_TIMEOUT);
 }
 
 Code Cellular::deleteAllReceivedSms()
 {
-    return sendBasicCommand("AT+CMGD=1,4", 1000);
+    return sendBasicCommand("AT+CMGD=1,4", SMS_TIMEOUT);
 }
 
 Code Cellular::sendBasicCommand(const std::string& command, unsigned int timeoutMillis, char esc)
@@ -826,10 +1255,17 @@ Code Cellular::sendBasicCommand(const std::string& command, unsigned int timeout
 
 string Cellular::sendCommand(const std::string& command, unsigned int timeoutMillis, char esc)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return "";
     }
+    //The radio is answering a socket open, its response must not be taken by
+    //a command from another thread. An abandoned open ends at its timeout
+    if(openState == OPENING && checkOpen() == OPENING) {
+        printf("[ERROR] socket open in progress. Can not send AT commands\r\n");
+        return "";
+    }
     if(socketOpened) {
         printf("[ERROR] socket is open. Can not send AT commands\r\n");
         return "";
@@ -884,9 +1320,119 @@ string Cellular::sendCommand(const std::string& command, unsigned int timeoutMil
         }
     } while (!done);
 
+    DataUsage usage = DataUsage();
+    usage.commandTx = command.size() + ((esc != 0x00) ? 1 : 0);
+    usage.commandRx = result.size();
+    addUsage(usage);
+
     return result;
 }
 
+Cellular::DataUsage Cellular::getDataUsage()
+{
+    ScopedLock guard(lock);
+    return lifetimeUsage;
+}
+
+Cellular::DataUsage Cellular::getSocketUsage()
+{
+    ScopedLock guard(lock);
+    return socketUsage;
+}
+
+Cellular::DataUsage Cellular::getDataUsageSince(const DataUsage& mark)
+{
+    ScopedLock guard(lock);
+    DataUsage usage = DataUsage();
+    usage.payloadTx = lifetimeUsage.payloadTx - mark.payloadTx;
+    usage.payloadRx = lifetimeUsage.payloadRx - mark.payloadRx;
+    usage.escapeTx = lifetimeUsage.escapeTx - mark.escapeTx;
+    usage.escapeRx = lifetimeUsage.escapeRx - mark.escapeRx;
+    usage.commandTx = lifetimeUsage.commandTx - mark.commandTx;
+    usage.commandRx = lifetimeUsage.commandRx - mark.commandRx;
+    usage.retries = lifetimeUsage.retries - mark.retries;
+    return usage;
+}
+
+void Cellular::setDataUsage(const DataUsage& usage)
+{
+    ScopedLock guard(lock);
+    lifetimeUsage = usage;
+}
+
+void Cellular::resetDataUsage()
+{
+    ScopedLock guard(lock);
+    lifetimeUsage = DataUsage();
+    socketUsage = DataUsage();
+}
+
+void Cellular::detachUsagePersist()
+{
+    usagePersistInterval = 0;
+}
+
+void Cellular::startUsagePersist(unsigned int intervalMillis)
+{
+    usagePersistInterval = intervalMillis;
+    usagePersistTimer.reset();
+    usagePersistTimer.start();
+}
+
+void Cellular::addUsage(const DataUsage& usage)
+{
+    ScopedLock guard(lock);
+    lifetimeUsage.payloadTx += usage.payloadTx;
+    lifetimeUsage.payloadRx += usage.payloadRx;
+    lifetimeUsage.escapeTx += usage.escapeTx;
+    lifetimeUsage.escapeRx += usage.escapeRx;
+    lifetimeUsage.commandTx += usage.commandTx;
+    lifetimeUsage.commandRx += usage.commandRx;
+    lifetimeUsage.retries += usage.retries;
+
+    if(socketOpened) {
+        socketUsage.payloadTx += usage.payloadTx;
+        socketUsage.payloadRx += usage.payloadRx;
+        socketUsage.escapeTx += usage.escapeTx;
+        socketUsage.escapeRx += usage.escapeRx;
+        socketUsage.retries += usage.retries;
+    }
+
+    if(usagePersistInterval != 0 && usagePersistTimer.read_ms() >= static_cast<int>(usagePersistInterval)) {
+        usagePersistTimer.reset();
+        usagePersist.call();
+    }
+}
+
+void Cellular::countRetry()
+{
+    DataUsage usage = DataUsage();
+    usage.retries = 1;
+    addUsage(usage);
+}
+
+std::string Cellular::getRadioNames(Vars::Radio radio)
+{
+    switch(radio) {
+        case Vars::NA:
+            return "NA";
+        case Vars::E1:
+            return "E1";
+        case Vars::G2:
+            return "G2";
+        case Vars::EV2:
+            return "EV2";
+        case Vars::H4:
+            return "H4";
+        case Vars::EV3:
+            return "EV3";
+        case Vars::H5:
+            return "H5";
+        default:
+            return "UNKNOWN ENUM";
+    }
+}
+
 std::string Cellular::getRegistrationNames(Registration registration)
 {
     switch(registration) {
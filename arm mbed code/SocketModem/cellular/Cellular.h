@@ -19,6 +19,8 @@
 
 #include "IPStack.h"
 #include "MTSBufferedIO.h"
+#include "MTSLinkMonitor.h"
+#include "MTSLock.h"
 #include "mbed.h"
 #include <string>
 #include <vector>
@@ -268,6 +270,54 @@ public:
         std::string timestamp;
     };
 
+    /** This structure contains the timing and buffering parameters that are
+    * tuned for a specific cellular radio type.
+    */
+    struct RadioProfile {
+        /// The radio type this profile applies to
+        Vars::Radio radio;
+        /// MultiTech product name that identifies the radio in the ATI or AT+CGMM
+        /// response, for example "MTSMC-H5"
+        const char* model;
+        /// Timeout in milliseconds for basic AT commands that the radio answers
+        /// locally, like AT, ATE0, AT+CSQ and the socket port settings. SMS,
+        /// data context and DNS commands have their own longer timeouts.
+        unsigned int commandTimeout;
+        /// Timeout in milliseconds for opening a socket (AT#OTCP, AT#OUDP)
+        unsigned int socketOpenTimeout;
+        /// Timeout in milliseconds for bringing up the PPP link (AT#CONNECTIONSTART)
+        unsigned int connectTimeout;
+        /// Recommended size in bytes of the serial Tx buffer
+        int txBufferSize;
+        /// Recommended size in bytes of the serial Rx buffer
+        int rxBufferSize;
+        /// Highest baud rate supported by the radio
+        int maxBaud;
+    };
+
+    /** This structure contains byte counters for the traffic exchanged with
+    * the radio. Payload counters hold socket data without escape characters,
+    * escape counters the DLE characters added or removed to protect ETX and DLE
+    * in the payload, and command counters everything sent and received while
+    * processing AT commands.
+    */
+    struct DataUsage {
+        /// Socket payload bytes written
+        unsigned long payloadTx;
+        /// Socket payload bytes read
+        unsigned long payloadRx;
+        /// DLE escape bytes added to written payload
+        unsigned long escapeTx;
+        /// DLE escape bytes removed from read payload
+        unsigned long escapeRx;
+        /// AT command bytes written
+        unsigned long commandTx;
+        /// AT command response bytes read
+        unsigned long commandRx;
+        /// Number of commands and escape writes that had to be repeated
+        unsigned long retries;
+    };
+
     /** Destructs a Cellular object and frees all related resources.
     */
     ~Cellular();
@@ -306,6 +356,101 @@ public:
     */
     bool init(MTSBufferedIO* io, PinName DCD = NC, PinName DTR = NC);
 
+    /** This method returns the radio type that was identified during init.
+    *
+    * @returns the radio type, Vars::NA if it could not be identified.
+    */
+    Vars::Radio getRadioType();
+
+    /** This method returns the timing and buffering profile currently in use.
+    * The profile is selected by radio type during init. The buffer sizes and
+    * baud rate are recommendations for constructing the MTSBufferedIO object.
+    *
+    * @returns the active radio profile.
+    */
+    const RadioProfile& getRadioProfile();
+
+    /** This method overrides the timing and buffering profile currently in use,
+    * for example to relax timeouts on a poor network.
+    *
+    * @param profile the profile to use.
+    */
+    void setRadioProfile(const RadioProfile& profile);
+
+    /** This method returns the traffic counters accumulated since the object was
+    * created, the last resetDataUsage call, or the values restored with setDataUsage.
+    *
+    * @returns the lifetime traffic counters.
+    */
+    DataUsage getDataUsage();
+
+    /** This method returns the traffic counters of the current or, once closed,
+    * the last socket connection. AT command traffic is not part of these counters.
+    *
+    * @returns the socket traffic counters.
+    */
+    DataUsage getSocketUsage();
+
+    /** This method returns the traffic since a mark that was taken with
+    * getDataUsage. Taking a mark before and calling this after a request gives
+    * the cost of the request, also when one socket carries several requests.
+    * The counters must not be reset or restored in between.
+    *
+    * @param mark the lifetime traffic counters at the start of the request.
+    * @returns the traffic counters accumulated since the mark.
+    */
+    DataUsage getDataUsageSince(const DataUsage& mark);
+
+    /** This method restores the lifetime traffic counters, typically from values
+    * saved by a persistence callback before the last reset.
+    *
+    * @param usage the counters to continue from.
+    */
+    void setDataUsage(const DataUsage& usage);
+
+    /** This method clears the lifetime and socket traffic counters.
+    */
+    void resetDataUsage();
+
+    /** This method is used to setup a callback function that persists the traffic
+    * counters. The callback is made from within read, write and command processing
+    * once the interval has expired and should call getDataUsage to get the values.
+    *
+    * @param tptr a pointer to the object to be called.
+    * @param mptr a pointer to the function within the object to be called.
+    * @param intervalMillis the minimum time between callbacks in milliseconds.
+    */
+    template<typename T>
+    void attachUsagePersist(T *tptr, void( T::*mptr)(void), unsigned int intervalMillis)
+    {
+        usagePersist.attach(tptr, mptr);
+        startUsagePersist(intervalMillis);
+    }
+
+    /** This method is used to setup a callback function that persists the traffic
+    * counters. The callback is made from within read, write and command processing
+    * once the interval has expired and should call getDataUsage to get the values.
+    *
+    * @param fptr a pointer to the static function to be called.
+    * @param intervalMillis the minimum time between callbacks in milliseconds.
+    */
+    void attachUsagePersist(void(*fptr)(void), unsigned int intervalMillis)
+    {
+        usagePersist.attach(fptr);
+        startUsagePersist(intervalMillis);
+    }
+
+    /** This method stops the traffic counter persistence callbacks.
+    */
+    void detachUsagePersist();
+
+    /** A static method for getting the built in profile for a radio type.
+    *
+    * @param type the radio type.
+    * @returns the profile for the radio type, or the default profile.
+    */
+    static const RadioProfile& getRadioProfile(Vars::Radio type);
+
     // Radio link related commands
     /** This method establishes a data connection on the cellular radio.
     * Note that before calling you must have an activated radio and if
@@ -332,12 +477,17 @@ public:
     // For behavior of the following methods refer to IPStack.h documentation
     virtual bool bind(unsigned int port);
     virtual bool open(const std::string& address, unsigned int port, Mode mode);
+    virtual bool startOpen(const std::string& address, unsigned int port, Mode mode);
+    virtual OpenState checkOpen();
     virtual bool isOpen();
     virtual bool close();
     virtual int read(char* data, int max, int timeout = -1);
     virtual int write(const char* data, int length, int timeout = -1);
+    virtual int peek(const char*& data);
+    virtual void consume(int length);
     virtual unsigned int readable();
     virtual unsigned int writeable();
+    virtual int poll(int events, int timeoutMillis);
 
     //Other
     /** A method to reset the Multi-Tech Socket Modem.  This command brings down the
@@ -352,7 +502,8 @@ public:
 
     //Cellular Radio Specific
     /** A method for sending a generic AT command to the radio. Note that you cannot
-    * send commands and have a data connection at the same time.
+    * send commands and have a data connection at the same time. The command is
+    * sent while holding the lock of the radio, see MTSLock.h.
     *
     * @param command the command to send to the radio without the escape character.
     * @param timeoutMillis the time in millis to wait for a response before returning.
@@ -438,6 +589,34 @@ public:
     */
     bool ping(const std::string& address = "8.8.8.8");
 
+    /** This method is used to measure the round trip time to a server with a
+    * single ping. Note that the time is measured around the AT#PING command
+    * and therefore includes the command processing overhead of the radio.
+    *
+    * @param address the address of the server in format xxx.xxx.xxx.xxx.
+    * @returns the round trip time in milliseconds, or -1 if the ping failed.
+    */
+    int getPingTime(const std::string& address = "8.8.8.8");
+
+    /** This method takes a link quality sample if one is due according to the
+    * interval configured on the LinkMonitor. A sample consists of the signal
+    * strength, the registration state and, if a PPP session is up, a timed
+    * ping. Since AT commands can not be sent while a socket is open no sample
+    * is taken in that case, socket open times are recorded instead. This
+    * method is meant to be called periodically from the application loop.
+    *
+    * @param address the address of the server to ping in format xxx.xxx.xxx.xxx.
+    * @param force if true a sample is taken even if the interval has not expired.
+    * @returns true if a sample was taken, otherwise false.
+    */
+    bool updateLinkQuality(const std::string& address = "8.8.8.8", bool force = false);
+
+    /** This method returns the link quality history and statistics for the radio.
+    *
+    * @returns a reference to the LinkMonitor object of this radio.
+    */
+    LinkMonitor& getLinkMonitor();
+
     /** This method can be used to trade socket functionality for performance.
     * In order to enable a socket connection to be closed by the client side programtically,
     * this class must process all read and write data on the socket to guard the special
@@ -497,10 +676,20 @@ public:
     */
     static std::string getRegistrationNames(Registration registration);
 
+    /** A static method for getting a string representation for the Radio
+    * enumeration.
+    *
+    * @param radio a Vars::Radio enumeration.
+    * @returns the enumeration name as a string.
+    */
+    static std::string getRadioNames(Vars::Radio radio);
+
 private:
     static Cellular* instance; //Static pointer to the single Cellular object.
+    static const RadioProfile radioProfiles[]; //Table of built in radio profiles.
 
     MTSBufferedIO* io; //IO interface obect that the radio is accessed through.
+    Lock lock; //Held for every socket operation and command sequence, see MTSLock.h
     bool echoMode; //Specifies if the echo mode is currently enabled.
 
     bool pppConnected; //Specifies if a PPP session is currently connected.
@@ -515,9 +704,41 @@ private:
     std::string host_address; //Holds the remote address for socket connections.
     DigitalIn* dcd; //Maps to the radios dcd signal
     DigitalOut* dtr; //Maps to the radios dtr signal
+    LinkMonitor linkMonitor; //Holds the link quality history of the radio
+    OpenState openState; //State of the socket open in progress
+    std::string openAddress; //Address passed to the socket open in progress
+    bool openResolved; //Specifies if the open in progress uses a cached resolution
+    bool dnsQuery; //Specifies if the radio accepts AT#QDNS, cleared once it was rejected
+    std::string openResponse; //Response received so far to the open command
+    Timer openTimer; //Time since the open command was sent
+    bool rxEscaped; //Specifies if the front received byte followed a DLE escape
+    char rxHeld[20]; //Received bytes held back because they start the socket closed message
+    int rxHeldStart; //Index of the first held byte that was not consumed
+    int rxHeldLength; //Number of held bytes that were not consumed
+    bool rxHeldPayload; //Specifies if the held bytes turned out to be payload
+    Vars::Radio radio; //The radio type identified during init
+    RadioProfile profile; //The timing and buffering profile in use
+
+    DataUsage lifetimeUsage; //Traffic counters since creation or reset
+    DataUsage socketUsage; //Traffic counters of the current or last socket
+    FunctionPointer usagePersist; //Callback used to persist the traffic counters
+    unsigned int usagePersistInterval; //Time between persistence callbacks, 0 if disabled
+    Timer usagePersistTimer; //Time since the last persistence callback
+
+    Vars::Radio detectRadio(); //Identifies the radio using ATI and AT+CGMM
+    std::string lookupHost(const std::string& url); //Resolves a URL with AT#QDNS, empty if it could not
+    void startUsagePersist(unsigned int intervalMillis); //Starts the persistence timer
+    void addUsage(const DataUsage& usage); //Adds to the traffic counters
+    void countRetry(); //Counts a repeated command
+
+    bool configurePing(const std::string& address); //Sets the ping server and parameters
 
     Cellular(); //Private constructor, use the getInstance() method.
     Cellular(MTSBufferedIO* io); //Private constructor, use the getInstance() method.
+
+    static const unsigned int CONTEXT_TIMEOUT = 2000; //Timeout in ms for the APN, DNS, server and ping settings
+    static const unsigned int DNS_TIMEOUT = 10000; //Timeout in ms for resolving a host name with AT#QDNS
+    static const unsigned int SMS_TIMEOUT = 4000; //Timeout in ms for SMS commands, which use the SIM storage
 };
 
 }
@@ -19,4 +19,5 @@
 #include "MTSSerial.h"
 #include "MTSSerialFlowControl.h"
 #include "TCPSocketConnection.h"
+#include "UDPSocket.h"
 #include "Transport.h"
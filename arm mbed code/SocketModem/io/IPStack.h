@@ -39,6 +39,16 @@ public:
         TCP, UDP
     };
 
+    /// An enumeration of the states of a socket open started with startOpen.
+    enum OpenState {
+        OPEN_IDLE, OPENING, OPENED, OPEN_FAILED
+    };
+
+    /// An enumeration of socket readiness events used with poll, which can be combined.
+    enum Event {
+        READABLE = 0x01, WRITEABLE = 0x02, CLOSED = 0x04
+    };
+
     /** This method is used to connect the IP layer and below for the interface. Required
     * configurations and settings should be done in other calls or an init function.
     *
@@ -78,6 +88,29 @@ public:
     */
     virtual bool open(const std::string& address, unsigned int port, Mode mode) = 0;
 
+    /** This method is used to start opening a socket connection with the given
+    * parameters without waiting for the connection to be established. The
+    * settings are sent to the device and the open command is issued, then the
+    * method returns. If the network connection is not up it is connected first,
+    * which does block. Call checkOpen until it no longer returns OPENING, and do
+    * not call other methods of the device in the meantime.
+    *
+    * @param address is the address you want to connect to in the form of xxx.xxx.xxx.xxx
+    * or a URL.
+    * @param port the remote port you want to connect to.
+    * @param mode an enum that specifies whether this socket connection is type TCP or UDP.
+    * @returns true if the open was started or the socket is already open, otherwise false.
+    */
+    virtual bool startOpen(const std::string& address, unsigned int port, Mode mode) = 0;
+
+    /** This method is used to process the response of an open started with startOpen.
+    * It does not block, it only handles the data the device has sent so far.
+    *
+    * @returns OPENING while the open is in progress, OPENED once the socket is open,
+    * OPEN_FAILED if the open failed or timed out and OPEN_IDLE if no open was started.
+    */
+    virtual OpenState checkOpen() = 0;
+
     /** This method is used to determine if a socket connection is currently open.
     *
     * @returns true if the socket is currently open, otherwise false.
@@ -118,6 +151,25 @@ public:
     virtual int write(const char* data, int length, int timeout = -1) = 0;
 
 
+    /** This method is used to access received socket data without copying it.
+    * The returned view points into the device's receive buffer and has any
+    * transport escaping already removed, so it may be shorter than the data
+    * that is available. Bytes are removed from the socket with consume.
+    *
+    * @param data set to point to the first received byte.
+    * @returns the number of bytes available at data, 0 if there are none yet
+    * and -1 if the socket is not open.
+    */
+    virtual int peek(const char*& data) = 0;
+
+    /** This method is used to remove bytes that were accessed with peek from
+    * the socket.
+    *
+    * @param length the number of bytes to remove, at most the length returned
+    * by the last peek call.
+    */
+    virtual void consume(int length) = 0;
+
     /** This method is used to get the number of bytes available to read off the
     * socket.
     *
@@ -131,6 +183,21 @@ public:
     */
     virtual unsigned int writeable() = 0;
 
+    /** This method is used to wait until the socket is ready for one or more of
+    * the given events. While waiting the processor sleeps and is woken by the
+    * receive interrupt that fills the read buffer, so the wait does not spin.
+    * A socket is READABLE while received data is buffered, WRITEABLE while it
+    * is open and can accept data, and CLOSED once it is closed and all buffered
+    * data has been read.
+    *
+    * @param events the events to wait for as a bitwise OR of Event values.
+    * @param timeoutMillis the time in milliseconds to wait for an event. 0 only
+    * checks the current state and -1 waits until an event occurs.
+    * @returns the events that are ready as a bitwise OR of Event values, 0 if
+    * the timeout expired.
+    */
+    virtual int poll(int events, int timeoutMillis) = 0;
+
     /** This method is used to reset the device that provides the communications
     * capability. Note that you may have to wait some time after reset before the
     * device can be used.
@@ -110,10 +110,50 @@ int MTSBufferedIO::read(char& data)
     return rxBuffer.read(&data, 1);
 }
 
+int MTSBufferedIO::peek(const char*& data)
+{
+    return rxBuffer.peek(data);
+}
+
+int MTSBufferedIO::consume(int length)
+{
+    return rxBuffer.consume(length);
+}
+
 int MTSBufferedIO::readable() {
     return rxBuffer.size();   
 }
 
+int MTSBufferedIO::waitReadable(int timeoutMillis)
+{
+    if (timeoutMillis == 0 || !rxBuffer.isEmpty()) {
+        return rxBuffer.size();
+    }
+
+    //The timeout interrupt wakes the processor at the deadline
+    Timeout deadline;
+    Timer tmr;
+    tmr.start();
+    if (timeoutMillis > 0) {
+        deadline.attach(this, &MTSBufferedIO::wake, timeoutMillis / 1000.0f);
+    }
+    while (rxBuffer.isEmpty() && (timeoutMillis < 0 || tmr.read_ms() < timeoutMillis)) {
+        //Interrupts are masked between the check and the sleep so a byte that
+        //arrives in between still wakes the processor
+        __disable_irq();
+        if (rxBuffer.isEmpty()) {
+            __WFI();
+        }
+        __enable_irq();
+    }
+    deadline.detach();
+    return rxBuffer.size();
+}
+
+void MTSBufferedIO::wake()
+{
+}
+
 bool MTSBufferedIO::txEmpty()
 {
     return txBuffer.isEmpty();
@@ -130,6 +130,22 @@ public:
     */
     int read(char& data);
 
+    /** This method gives direct access to the contiguous data at the front of
+    * the Rx or read buffer without copying it. See MTSCircularBuffer::peek.
+    *
+    * @param data set to point to the first byte available for reading.
+    * @returns the number of contiguous bytes available at data, 0 if empty.
+    */
+    int peek(const char*& data);
+
+    /** This method removes bytes from the front of the Rx or read buffer,
+    * typically after they were accessed with peek.
+    *
+    * @param length the number of bytes to remove.
+    * @returns the number of bytes removed.
+    */
+    int consume(int length);
+
     /** This method is used to get the number of bytes available to read from
     * the Rx or read buffer.
     *
@@ -137,6 +153,16 @@ public:
     */
     int readable();
 
+    /** This method waits until data is available in the Rx or read buffer. While
+    * waiting the processor sleeps until the next interrupt, which is the receive
+    * interrupt filling the buffer or the timeout, instead of spinning.
+    *
+    * @param timeoutMillis the time in milliseconds to wait for data. If set to
+    * -1 the call waits until data arrives.
+    * @returns the number of bytes available, 0 if the timeout expired.
+    */
+    int waitReadable(int timeoutMillis);
+
     /** This method determines if the Tx or write buffer is empty.
     *
     * @returns true if empty, otherwise false.
@@ -183,6 +209,9 @@ public:
     */
     virtual void handleRead() = 0;
 
+private:
+    void wake(); // Timeout handler that only wakes the processor
+
 protected:
     MTSCircularBuffer txBuffer; // Internal write or transmit circular buffer
     MTSCircularBuffer rxBuffer; // Internal read or receieve circular buffer
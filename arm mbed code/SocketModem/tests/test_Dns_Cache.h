@@ -0,0 +1,97 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TESTDNSCACHE_H
+#define TESTDNSCACHE_H
+
+#include "MTSDnsCache.h"
+
+/* unit tests for the dns cache class */
+
+using namespace mts;
+
+int testDnsCache()
+{
+    printf("Testing: DnsCache\r\n");
+    int failed = 0;
+    DnsCache cache;
+    std::string ip;
+
+    //Test miss and hit
+    if (cache.lookup("api-m2x.att.com", ip) != DnsCache::MISS) {
+        printf("Failed: lookup() - empty\r\n");
+        failed++;
+    }
+    cache.add("api-m2x.att.com", "54.84.10.1");
+    if (cache.lookup("api-m2x.att.com", ip) != DnsCache::HIT || ip != "54.84.10.1") {
+        printf("Failed: lookup() - hit\r\n");
+        failed++;
+    }
+
+    //Test that a failure does not replace a valid address
+    cache.addFailure("api-m2x.att.com");
+    if (cache.lookup("api-m2x.att.com", ip) != DnsCache::HIT) {
+        printf("Failed: addFailure() - valid entry\r\n");
+        failed++;
+    }
+
+    //Test negative caching
+    cache.addFailure("unknown.example");
+    if (cache.lookup("unknown.example", ip) != DnsCache::NEGATIVE) {
+        printf("Failed: lookup() - negative\r\n");
+        failed++;
+    }
+
+    //Test removal
+    cache.remove("api-m2x.att.com");
+    if (cache.lookup("api-m2x.att.com", ip) != DnsCache::MISS) {
+        printf("Failed: remove()\r\n");
+        failed++;
+    }
+
+    //Test eviction keeps the cache size fixed
+    cache.clear();
+    char host[16];
+    for (int i = 0; i <= DnsCache::CACHE_SIZE; i++) {
+        sprintf(host, "host%d", i);
+        cache.add(host, "10.0.0.1");
+    }
+    int hits = 0;
+    for (int i = 0; i <= DnsCache::CACHE_SIZE; i++) {
+        sprintf(host, "host%d", i);
+        if (cache.lookup(host, ip) == DnsCache::HIT) {
+            hits++;
+        }
+    }
+    if (hits != DnsCache::CACHE_SIZE) {
+        printf("Failed: add() - eviction [%d]\r\n", hits);
+        failed++;
+    }
+
+    //Test expiry
+    cache.clear();
+    cache.setTtl(0, 0);
+    cache.add("api-m2x.att.com", "54.84.10.1");
+    if (cache.lookup("api-m2x.att.com", ip) != DnsCache::MISS) {
+        printf("Failed: lookup() - expired\r\n");
+        failed++;
+    }
+
+    printf("Finished Testing: DnsCache\r\n");
+    return failed;
+}
+
+#endif /* TESTDNSCACHE_H */
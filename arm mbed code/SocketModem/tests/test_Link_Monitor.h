@@ -0,0 +1,130 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TESTLINKMONITOR_H
+#define TESTLINKMONITOR_H
+
+#include "MTSLinkMonitor.h"
+
+/* unit tests for the link monitor class */
+
+using namespace mts;
+
+int testLinkMonitor()
+{
+    printf("Testing: LinkMonitor\r\n");
+    int failed = 0;
+    LinkMonitor monitor(1000);
+    LinkMonitor::Sample sample;
+
+    //Test empty history
+    if (monitor.size() != 0 || monitor.getScore() != -1 || monitor.getAvgRtt() != -1) {
+        printf("Failed: empty history\r\n");
+        failed++;
+    }
+    if (!monitor.isDue()) {
+        printf("Failed: isDue() - empty\r\n");
+        failed++;
+    }
+
+    //Test statistics over 1..20 ms round trip times
+    for (int i = 1; i <= 20; i++) {
+        monitor.addSample(80, i, true, true);
+    }
+    if (monitor.size() != LinkMonitor::HISTORY_SIZE) {
+        printf("Failed: size() - wrapped\r\n");
+        failed++;
+    }
+    if (!monitor.getSample(0, sample) || sample.rtt != 20) {
+        printf("Failed: getSample() - newest\r\n");
+        failed++;
+    }
+    if (monitor.getSample(LinkMonitor::HISTORY_SIZE, sample)) {
+        printf("Failed: getSample() - out of range\r\n");
+        failed++;
+    }
+    if (monitor.getMinRtt() != 5) {
+        printf("Failed: getMinRtt() [%d]\r\n", monitor.getMinRtt());
+        failed++;
+    }
+    if (monitor.getAvgRtt() != 12) {
+        printf("Failed: getAvgRtt() [%d]\r\n", monitor.getAvgRtt());
+        failed++;
+    }
+    if (monitor.getP95Rtt() != 20) {
+        printf("Failed: getP95Rtt() [%d]\r\n", monitor.getP95Rtt());
+        failed++;
+    }
+    if (monitor.isDue()) {
+        printf("Failed: isDue() - just sampled\r\n");
+        failed++;
+    }
+
+    //Test loss and score
+    monitor.clear();
+    monitor.addSample(100, 100, true, true);
+    monitor.addSample(100, -1, true, true);
+    if (monitor.getLoss() != 50) {
+        printf("Failed: getLoss() [%d]\r\n", monitor.getLoss());
+        failed++;
+    }
+    if (monitor.getScore() != 90) {
+        printf("Failed: getScore() [%d]\r\n", monitor.getScore());
+        failed++;
+    }
+    monitor.addSample(100, -1, false, false);
+    if (monitor.getScore() != 0) {
+        printf("Failed: getScore() - not registered\r\n");
+        failed++;
+    }
+
+    //Test round trip times are stored on the newest sample and do not restart the interval
+    monitor.clear();
+    monitor.addRtt(300);
+    if (!monitor.isDue() || !monitor.getSample(0, sample) || !sample.registered) {
+        printf("Failed: addRtt() - empty\r\n");
+        failed++;
+    }
+    monitor.addSample(100, -1, false, false);
+    monitor.addRtt(200);
+    if (monitor.size() != 2 || !monitor.getSample(0, sample) || sample.rtt != 200 ||
+            !sample.probed || sample.registered || sample.signal != 100) {
+        printf("Failed: addRtt() - newest\r\n");
+        failed++;
+    }
+    monitor.addRtt(400);
+    if (monitor.size() != 3 || !monitor.getSample(0, sample) || sample.rtt != 400 ||
+            sample.registered || sample.signal != -1 || monitor.getScore() != 0) {
+        printf("Failed: addRtt() - registration\r\n");
+        failed++;
+    }
+
+    //Test signal conversions
+    if (LinkMonitor::csqToSignal(99) != -1 || LinkMonitor::csqToSignal(31) != 100) {
+        printf("Failed: csqToSignal()\r\n");
+        failed++;
+    }
+    if (LinkMonitor::rssiToSignal(99) != -1 || LinkMonitor::rssiToSignal(-60) != 50 ||
+            LinkMonitor::rssiToSignal(-100) != 0) {
+        printf("Failed: rssiToSignal()\r\n");
+        failed++;
+    }
+
+    printf("Finished Testing: LinkMonitor\r\n");
+    return failed;
+}
+
+#endif /* TESTLINKMONITOR_H */
@@ -233,6 +233,27 @@ int testMTSCircularBuffer()
         failed++;
     }
 
+    //Test peek and consume across the wrap around
+    {
+        MTSCircularBuffer ring(5);
+        const char* data;
+        ring.write("ABC", 3);
+        ring.consume(2);
+        ring.write("DEFG", 4);
+        if (ring.peek(data) != 3 || strncmp(data, "CDE", 3) != 0) {
+            printf("Failed: peek() - before wrap\r\n");
+            failed++;
+        }
+        if (ring.consume(3) != 3 || ring.peek(data) != 2 || strncmp(data, "FG", 2) != 0) {
+            printf("Failed: peek() - after wrap\r\n");
+            failed++;
+        }
+        if (ring.consume(5) != 2 || ring.peek(data) != 0 || !ring.isEmpty()) {
+            printf("Failed: consume() - past end\r\n");
+            failed++;
+        }
+    }
+
     //Test Ins and Outs
     {
         const char inData[] = "*ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz1234567890*";
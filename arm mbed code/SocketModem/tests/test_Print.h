@@ -0,0 +1,100 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TESTPRINT_H
+#define TESTPRINT_H
+
+#include "BufferPrint.h"
+#include <cstring>
+
+/* unit tests for the number formatting of the M2X print class */
+
+static bool printsDouble(double n, int digits, const char* expected)
+{
+    uint8_t buf[32];
+    BufferPrint print(buf, sizeof(buf) - 1);
+    size_t length = print.print(n, digits);
+    buf[(length < sizeof(buf)) ? length : sizeof(buf) - 1] = '\0';
+    if (length != strlen(expected) || strcmp((const char*) buf, expected) != 0) {
+        printf("Failed: print(double) [%s] expected [%s]\r\n", buf, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool printsLong(long n, const char* expected)
+{
+    uint8_t buf[32];
+    BufferPrint print(buf, sizeof(buf) - 1);
+    size_t length = print.print(n);
+    buf[(length < sizeof(buf)) ? length : sizeof(buf) - 1] = '\0';
+    if (length != strlen(expected) || strcmp((const char*) buf, expected) != 0) {
+        printf("Failed: print(long) [%s] expected [%s]\r\n", buf, expected);
+        return false;
+    }
+    return true;
+}
+
+int testPrint()
+{
+    printf("Testing: Print\r\n");
+    int failed = 0;
+
+    //Test integers including the limits of a 32 bit long
+    failed += !printsLong(0, "0");
+    failed += !printsLong(-42, "-42");
+    failed += !printsLong(2147483647L, "2147483647");
+    failed += !printsLong(-2147483647L - 1, "-2147483648");
+
+    //Test fractions, negatives and trailing zeros
+    failed += !printsDouble(0, 2, "0");
+    failed += !printsDouble(12.5, 2, "12.5");
+    failed += !printsDouble(-12.25, 2, "-12.25");
+    failed += !printsDouble(3.0, 7, "3");
+    failed += !printsDouble(33.7490, 7, "33.749");
+    failed += !printsDouble(-84.3880, 7, "-84.388");
+    failed += !printsDouble(2.5, 0, "3");
+
+    //Test rounding that carries into the integer part
+    failed += !printsDouble(9.999, 2, "10");
+    failed += !printsDouble(-99.9996, 3, "-100");
+    failed += !printsDouble(0.9999, 2, "1");
+
+    //Test values from 2^32 up, which are printed with an exponent
+    failed += !printsDouble(4294967295.0, 2, "4.29e+09");
+    failed += !printsDouble(4294967296.0, 2, "4.29e+09");
+    failed += !printsDouble(1e12, 2, "1e+12");
+    failed += !printsDouble(-1.5e100, 2, "-1.5e+100");
+    failed += !printsDouble(9999999999.6, 2, "1e+10");
+
+    //Test values smaller than the last digit keep an exponent instead of printing 0
+    failed += !printsDouble(0.004, 3, "0.004");
+    failed += !printsDouble(0.001, 2, "1e-03");
+    failed += !printsDouble(-0.00012, 2, "-1.2e-04");
+    failed += !printsDouble(0.0099999, 2, "1e-02");
+    failed += !printsDouble(1.5e-300, 7, "1.5e-300");
+
+    //Test values that are not numbers
+    double zero = 0;
+    failed += !printsDouble(zero / zero, 2, "nan");
+    failed += !printsDouble(1 / zero, 2, "inf");
+    failed += !printsDouble(-1 / zero, 2, "-inf");
+
+    printf("Finished Testing: Print\r\n");
+    return failed;
+}
+
+#endif /* TESTPRINT_H */
@@ -0,0 +1,113 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TESTREQUESTQUEUE_H
+#define TESTREQUESTQUEUE_H
+
+#include "MTSRequestQueue.h"
+
+/* unit tests for the request queue class */
+
+using namespace mts;
+
+static int requestOrder[RequestQueue::QUEUE_SIZE + 2];
+static int requestCount = 0;
+
+static void requestOne()
+{
+    requestOrder[requestCount++] = 1;
+}
+
+static void requestTwo()
+{
+    requestOrder[requestCount++] = 2;
+}
+
+class RequestCounter
+{
+public:
+    RequestCounter() : count(0) {}
+    void increment() {
+        requestOrder[requestCount++] = 3;
+        count++;
+    }
+    int count;
+};
+
+int testRequestQueue()
+{
+    printf("Testing: RequestQueue\r\n");
+    int failed = 0;
+    RequestQueue queue;
+    RequestCounter counter;
+
+    //Test empty queue
+    if (queue.size() != 0 || queue.service() != 0) {
+        printf("Failed: empty queue\r\n");
+        failed++;
+    }
+
+    //Test requests run in the order they were posted
+    requestCount = 0;
+    queue.post(&requestTwo);
+    queue.post(&counter, &RequestCounter::increment);
+    queue.post(&requestOne);
+    if (queue.size() != 3 || requestCount != 0) {
+        printf("Failed: post() - ran early\r\n");
+        failed++;
+    }
+    if (queue.service(2) != 2 || queue.size() != 1) {
+        printf("Failed: service() - max\r\n");
+        failed++;
+    }
+    if (queue.service() != 1 || requestCount != 3 || requestOrder[0] != 2 ||
+            requestOrder[1] != 3 || requestOrder[2] != 1 || counter.count != 1) {
+        printf("Failed: service() - order\r\n");
+        failed++;
+    }
+
+    //Test a full queue rejects requests
+    requestCount = 0;
+    for (int i = 0; i < RequestQueue::QUEUE_SIZE; i++) {
+        if (!queue.post(&requestOne)) {
+            printf("Failed: post() - %d\r\n", i);
+            failed++;
+        }
+    }
+    if (queue.post(&requestTwo) || queue.size() != RequestQueue::QUEUE_SIZE) {
+        printf("Failed: post() - full\r\n");
+        failed++;
+    }
+    queue.service();
+
+    //Test call runs directly without an I/O thread and leaves posted requests queued
+    requestCount = 0;
+    queue.post(&requestOne);
+    if (!queue.call(&requestTwo) || queue.size() != 1 || requestCount != 1 ||
+            requestOrder[0] != 2) {
+        printf("Failed: call()\r\n");
+        failed++;
+    }
+    if (queue.service() != 1 || requestCount != 2 || requestOrder[1] != 1) {
+        printf("Failed: call() - posted\r\n");
+        failed++;
+    }
+
+    printf("Finished Testing: RequestQueue\r\n");
+    return failed;
+}
+
+#endif /* TESTREQUESTQUEUE_H */
@@ -0,0 +1,132 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef _TEST_UDP_SOCKET_ECHO_H_
+#define _TEST_UDP_SOCKET_ECHO_H_
+
+/* test UDP socket communication over the cellular shield board
+ * designed to talk to remote echo server
+ * will talk to server until echo doesn't match sent data */
+//Setup a netcat server with command: ncat -u -l 5799 -k -e /bin/cat
+
+using namespace mts;
+
+bool testUdpSocketEchoLoop(UDPSocket& socket, Endpoint& server);
+
+void testUdpSocketEcho() {
+    Code code;
+    const int TEST_PORT = 5799;
+    const char TEST_SERVER[] = "" /* public IP of server running the netcat command given above */;
+    
+    printf("UDP SOCKET TESTING\r\n");
+    for (int i = 30; i >= 0; i = i - 2) {
+        wait(2);
+        printf("Waiting %d seconds...\n\r", i);
+    }  
+    Transport::setTransport(Transport::CELLULAR);
+    MTSSerialFlowControl* serial = new MTSSerialFlowControl(PTD3, PTD2, PTA12, PTC8);
+    serial->baud(115200);
+    Cellular::getInstance()->init(serial);
+    
+    printf("Setting APN\r\n");
+    code = Cellular::getInstance()->setApn("wap.cingular");
+    if(code == SUCCESS) {
+        printf("Success!\r\n");
+    } else {
+        printf("Error during APN setup [%d]\r\n", (int)code);
+    }
+    
+    printf("Establishing Connection\r\n");
+    if(Cellular::getInstance()->connect()) {
+        printf("Success!\r\n");
+    } else {
+        printf("Error during connection.  Aborting.\r\n");
+        return;
+    }
+    
+    UDPSocket socket;
+    socket.init();
+    socket.set_blocking(false, 15000);
+    Endpoint server;
+    server.set_address(TEST_SERVER, TEST_PORT);
+    
+    int count = 0;
+    while(testUdpSocketEchoLoop(socket, server)) {
+        count++;  
+        printf("Successful Echos: [%d]\r\n", count);  
+    }
+        
+    printf("Closing socket\r\n");
+    socket.close();
+    
+    wait(10);
+    
+    printf("Disconnecting\r\n");
+    Cellular::getInstance()->disconnect();   
+}
+
+bool testUdpSocketEchoLoop(UDPSocket& socket, Endpoint& server) {
+    using namespace mts;
+    //DLE (0x10) and ETX (0x03) check the escaping of the cellular socket
+    char buffer[] = "*ABCDEFGHIJKLMNOPQRSTUVWXYZ\x10\x03" "abcdefghijklmnopqrstuvwxyz1234567890*";
+    const int size = sizeof(buffer); 
+    char echoData[size];
+    
+    printf("Sending datagram\r\n");
+    int bytesWritten = socket.sendTo(server, buffer, size);
+    if(bytesWritten == size) {
+        printf("Successfully sent datagram\r\n");
+    } else {
+        printf("Failed to send datagram.  Aborting.\r\n");
+        return false;
+    }
+    
+    printf("Receiving echo (timeout = 15 seconds)\r\n");
+    Timer tmr;
+    Endpoint sender;
+    int bytesRead = 0;
+    tmr.start();
+    do {
+        int status = socket.receiveFrom(sender, &echoData[bytesRead], size - bytesRead);
+        if(status != -1) {
+            bytesRead += status;
+        } else {
+            printf("Error reading from socket.  Aborting.\r\n");
+            return false;
+        }
+        printf("Total bytes read %d\r\n", bytesRead);
+    } while (tmr.read_ms() <= 15000 && bytesRead < size);
+
+    if(sender.get_port() != server.get_port() || strcmp(sender.get_address(), server.get_address()) != 0) {
+        printf("Echo came from an unexpected endpoint [%s:%d]\r\n", sender.get_address(), sender.get_port());
+        return false;
+    }
+
+    printf("Comparing Buffers\r\n");
+    printf("SENT [%d] RECV [%d]\r\n", size, bytesRead);
+    if(bytesRead != size) {
+        return false;
+    }
+    for(int i = 0; i < size - 1; i++) {
+        if(buffer[i] != echoData[i]) {
+            printf("Buffers do not match at index %d\r\n", i);
+            return false;   
+        }   
+    }   
+    return true;
+}
+
+#endif
@@ -0,0 +1,191 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef TESTUDPSOCKETLOOPBACK_H
+#define TESTUDPSOCKETLOOPBACK_H
+
+#include "Cellular.h"
+#include "Transport.h"
+#include "UDPSocket.h"
+#include "MTSBufferedIO.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+/* unit tests for the UDP socket over the cellular radio, using a fake radio
+ * that answers AT commands and echoes socket data, so no network is needed.
+ * Received data is a byte stream, so the echo is read until it is complete */
+
+using namespace mts;
+
+class LoopbackRadio : public MTSBufferedIO
+{
+public:
+    LoopbackRadio() : commands(0), dataMode(false), escaped(false) {}
+
+    virtual void handleWrite() {
+        char byte;
+        while (txBuffer.read(byte) == 1) {
+            if (dataMode) {
+                echo(byte);
+            } else {
+                command(byte);
+            }
+        }
+    }
+
+    virtual void handleRead() {}
+
+    int commands; // number of commands received
+
+private:
+    bool dataMode; // specifies if socket data is echoed
+    bool escaped; // specifies if the last socket byte was a DLE
+    std::string line; // command received so far
+
+    void reply(const char* response) {
+        rxBuffer.write(response, strlen(response));
+    }
+
+    void command(char byte) {
+        //Commands are echoed like the radio does by default
+        rxBuffer.write(byte);
+        if (byte != '\r') {
+            line += byte;
+            return;
+        }
+        commands++;
+        if (line == "AT#VSTATE") {
+            reply("\r\n#VSTATE: CONNECTED\r\n\r\nOK\r\n");
+        } else if (line == "AT#OUDP" || line == "AT#OTCP=1") {
+            reply("\r\nOk_Info_WaitingForData\r\n");
+            dataMode = true;
+            escaped = false;
+        } else {
+            reply("\r\nOK\r\n");
+        }
+        line = "";
+    }
+
+    void echo(char byte) {
+        //Escaped bytes are echoed with their DLE, an ETX on its own closes the socket
+        if (!escaped && byte == 0x03) {
+            reply("Ok_Info_SocketClosed");
+            dataMode = false;
+            return;
+        }
+        escaped = !escaped && byte == 0x10;
+        rxBuffer.write(byte);
+    }
+};
+
+static bool receivesEcho(UDPSocket& socket, Endpoint& server, char* packet, int length, int bufferLength)
+{
+    char buffer[64];
+    Endpoint sender;
+    if (socket.sendTo(server, packet, length) != length) {
+        printf("Failed: sendTo of %d bytes\r\n", length);
+        return false;
+    }
+    int received = 0;
+    while (received < length) {
+        int result = socket.receiveFrom(sender, buffer + received, std::min(bufferLength, length - received));
+        if (result <= 0) {
+            printf("Failed: receiveFrom returned %d after %d bytes\r\n", result, received);
+            return false;
+        }
+        received += result;
+    }
+    if (memcmp(buffer, packet, length) != 0) {
+        printf("Failed: echo does not match the packet\r\n");
+        return false;
+    }
+    if (sender.get_port() != server.get_port() || strcmp(sender.get_address(), server.get_address()) != 0) {
+        printf("Failed: echo came from [%s:%d]\r\n", sender.get_address(), sender.get_port());
+        return false;
+    }
+    return true;
+}
+
+int testUdpSocketLoopback()
+{
+    printf("Testing: UDPSocket loopback\r\n");
+    int failed = 0;
+    LoopbackRadio radio;
+    Cellular* cellular = Cellular::getInstance();
+
+    Transport::setTransport(Transport::CELLULAR);
+    if (!cellular->init(&radio) || cellular->setApn("loopback") != SUCCESS) {
+        printf("Failed: radio setup\r\n");
+        return 1;
+    }
+
+    UDPSocket socket;
+    if (socket.init() != 0) {
+        printf("Failed: init\r\n");
+        return 1;
+    }
+    socket.set_blocking(false, 1000);
+    Endpoint server;
+    server.set_address("127.0.0.1", 5799);
+
+    //Test a packet with the DLE (0x10) and ETX (0x03) characters the radio escapes
+    char packet[] = "*ABCDEFGHIJ\x10\x03" "abcdefghij\x03\x10*";
+    failed += !receivesEcho(socket, server, packet, sizeof(packet) - 1, 64);
+    failed += !receivesEcho(socket, server, packet, sizeof(packet) - 1, 3);
+
+    //Test that the rest of a packet longer than the buffer is returned by the next call
+    char longPacket[] = "0123456789012345678901234567890123456789";
+    failed += !receivesEcho(socket, server, longPacket, sizeof(longPacket) - 1, 16);
+
+    //Test that closing the socket sends an unescaped ETX to the radio
+    socket.close();
+    if (cellular->isOpen()) {
+        printf("Failed: socket still open after close\r\n");
+        failed++;
+    }
+
+    //Test that WIFI, which has no UDP sockets, is never used for UDP
+    Transport::setTransport(Transport::WIFI);
+    if (Transport::getInstance(IPStack::UDP) != NULL) {
+        printf("Failed: WIFI returned for UDP\r\n");
+        failed++;
+    }
+    Transport::setTransport(Transport::AUTO);
+    Transport::addTransport(Transport::WIFI);
+    Transport::addTransport(Transport::CELLULAR);
+    if (Transport::getInstance(IPStack::UDP) == NULL || Transport::getSelected() != Transport::CELLULAR) {
+        printf("Failed: AUTO did not select CELLULAR for UDP\r\n");
+        failed++;
+    }
+
+    //Test that AUTO selection takes the link state from the newest sample instead of the radio
+    cellular->getLinkMonitor().addSample(80, -1, false, true);
+    int commands = radio.commands;
+    if (Transport::getInstance(IPStack::TCP) == NULL || Transport::getSelected() != Transport::CELLULAR ||
+            radio.commands != commands) {
+        printf("Failed: AUTO selection sent %d commands\r\n", radio.commands - commands);
+        failed++;
+    }
+    Transport::removeTransport(Transport::WIFI);
+    Transport::removeTransport(Transport::CELLULAR);
+    Transport::setTransport(Transport::CELLULAR);
+
+    printf("Finished Testing: UDPSocket loopback\r\n");
+    return failed;
+}
+
+#endif /* TESTUDPSOCKETLOOPBACK_H */
@@ -22,7 +22,13 @@
 //#include "test_SMS.h"
 //#include "test_TCP_Socket.h"
 //#include "test_TCP_Socket_Echo.h"
+//#include "test_UDP_Socket_Echo.h"
+//#include "test_UDP_Socket_Loopback.h"
 //#include "test_MTS_Circular_Buffer.h"
+//#include "test_Link_Monitor.h"
+//#include "test_Dns_Cache.h"
+//#include "test_Request_Queue.h"
+//#include "test_Print.h"
 
 
 //int main() {
@@ -58,6 +64,24 @@
     // TCP SOCKET ECHO TEST
     //testTcpSocketEcho();
     
+    // UDP SOCKET ECHO TEST
+    //testUdpSocketEcho();
+
+    // UDP SOCKET LOOPBACK TEST
+    //testUdpSocketLoopback();
+    
     // CIRCULAR BUFFER TEST
     //testMTSCircularBuffer();
+
+    // LINK MONITOR TEST
+    //testLinkMonitor();
+
+    // DNS CACHE TEST
+    //testDnsCache();
+
+    // REQUEST QUEUE TEST
+    //testRequestQueue();
+
+    // PRINT TEST
+    //testPrint();
 //}
@@ -61,6 +61,36 @@ int MTSCircularBuffer::read(char& data)
     return 1;
 }
 
+int MTSCircularBuffer::peek(const char*& data)
+{
+    if (bytes == 0) {
+        return 0;
+    }
+    if (readIndex == bufferSize) {
+        readIndex = 0;
+    }
+    data = &buffer[readIndex];
+    return MIN(bytes, bufferSize - readIndex);
+}
+
+int MTSCircularBuffer::consume(int length)
+{
+    length = MIN(MAX(length, 0), bytes);
+    if (length == 0) {
+        return 0;
+    }
+    if (readIndex == bufferSize) {
+        readIndex = 0;
+    }
+    readIndex += length;
+    if (readIndex > bufferSize) {
+        readIndex -= bufferSize;
+    }
+    bytes -= length;
+    checkThreshold();
+    return length;
+}
+
 int MTSCircularBuffer::write(const char* data, int length)
 {
     int i = 0;
@@ -60,6 +60,25 @@ public:
     */
     int read(char& data);
 
+    /** This method gives direct access to the data at the front of the buffer
+    * without copying it. Since the buffer wraps around, only the contiguous
+    * part of the data is returned. After consuming it the rest can be accessed
+    * with another call. The data stays valid until it is consumed.
+    *
+    * @param data set to point to the first byte available for reading.
+    * @returns the number of contiguous bytes available at data, 0 if empty.
+    */
+    int peek(const char*& data);
+
+    /** This method removes bytes from the front of the buffer, typically after
+    * they were accessed with peek.
+    *
+    * @param length the number of bytes to remove.
+    * @returns the number of bytes removed, which is less than length if fewer
+    * bytes were available.
+    */
+    int consume(int length);
+
     /** This method enables bulk writes to the buffer. If more data
     * is requested to be written then space available the method writes
     * as much data as possible and returns the actual amount written.
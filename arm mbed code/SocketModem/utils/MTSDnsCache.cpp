@@ -0,0 +1,189 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "MTSDnsCache.h"
+#include <cstring>
+#include <ctime>
+
+using namespace mts;
+
+DnsCache* DnsCache::instance = NULL;
+
+DnsCache* DnsCache::getInstance()
+{
+    if(instance == NULL) {
+        instance = new DnsCache();
+    }
+    return instance;
+}
+
+DnsCache::DnsCache()
+    : ttl(300)
+    , negativeTtl(30)
+    , refresh(false)
+    , useCounter(0)
+{
+    clear();
+}
+
+DnsCache::Result DnsCache::lookup(const std::string& host, std::string& ip)
+{
+    ScopedLock guard(lock);
+    Entry* entry = find(host);
+    if(entry == NULL) {
+        return MISS;
+    }
+    time_t now = time(NULL);
+    if(now >= entry->expires) {
+        entry->host[0] = '\0';
+        return MISS;
+    }
+    if(entry->ip[0] == '\0') {
+        return NEGATIVE;
+    }
+    entry->lastUse = ++useCounter;
+    entry->hit = true;
+    ip = entry->ip;
+    return HIT;
+}
+
+void DnsCache::add(const std::string& host, const std::string& ip)
+{
+    ScopedLock guard(lock);
+    if(ip.size() >= sizeof(entries[0].ip)) {
+        return;
+    }
+    Entry* entry = allocate(host);
+    if(entry == NULL) {
+        return;
+    }
+    time_t now = time(NULL);
+    strcpy(entry->ip, ip.c_str());
+    entry->added = now;
+    entry->expires = now + ttl;
+    entry->lastUse = ++useCounter;
+    entry->hit = false;
+}
+
+void DnsCache::addFailure(const std::string& host)
+{
+    ScopedLock guard(lock);
+    time_t now = time(NULL);
+    Entry* entry = find(host);
+    if(entry != NULL && entry->ip[0] != '\0' && now < entry->expires) {
+        return;
+    }
+    entry = allocate(host);
+    if(entry == NULL) {
+        return;
+    }
+    entry->ip[0] = '\0';
+    entry->added = now;
+    entry->expires = now + negativeTtl;
+    entry->lastUse = ++useCounter;
+    entry->hit = false;
+}
+
+void DnsCache::remove(const std::string& host)
+{
+    ScopedLock guard(lock);
+    Entry* entry = find(host);
+    if(entry != NULL) {
+        entry->host[0] = '\0';
+    }
+}
+
+void DnsCache::clear()
+{
+    ScopedLock guard(lock);
+    for(int i = 0; i < CACHE_SIZE; i++) {
+        entries[i].host[0] = '\0';
+        entries[i].ip[0] = '\0';
+    }
+}
+
+void DnsCache::setTtl(unsigned int ttl, unsigned int negativeTtl)
+{
+    ScopedLock guard(lock);
+    this->ttl = ttl;
+    this->negativeTtl = negativeTtl;
+}
+
+void DnsCache::setRefresh(bool enabled)
+{
+    ScopedLock guard(lock);
+    refresh = enabled;
+}
+
+bool DnsCache::getRefreshCandidate(std::string& host)
+{
+    ScopedLock guard(lock);
+    if(!refresh) {
+        return false;
+    }
+    time_t now = time(NULL);
+    for(int i = 0; i < CACHE_SIZE; i++) {
+        Entry& entry = entries[i];
+        if(entry.host[0] == '\0' || entry.ip[0] == '\0' || now >= entry.expires) {
+            continue;
+        }
+        //Only refresh names that are in use and in the last fifth of their lifetime
+        time_t window = (entry.expires - entry.added) / 5;
+        if(entry.hit && now >= entry.expires - window) {
+            //Report each use once, so a failing refresh is not retried constantly
+            entry.hit = false;
+            host = entry.host;
+            return true;
+        }
+    }
+    return false;
+}
+
+DnsCache::Entry* DnsCache::find(const std::string& host)
+{
+    for(int i = 0; i < CACHE_SIZE; i++) {
+        if(entries[i].host[0] != '\0' && host.compare(entries[i].host) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+DnsCache::Entry* DnsCache::allocate(const std::string& host)
+{
+    if(host.size() == 0 || host.size() > MAX_HOST_LENGTH) {
+        return NULL;
+    }
+    Entry* entry = find(host);
+    if(entry != NULL) {
+        return entry;
+    }
+
+    //Use a free or expired entry, otherwise evict the least recently used one
+    time_t now = time(NULL);
+    entry = &entries[0];
+    for(int i = 0; i < CACHE_SIZE; i++) {
+        if(entries[i].host[0] == '\0' || now >= entries[i].expires) {
+            entry = &entries[i];
+            break;
+        }
+        if(entries[i].lastUse < entry->lastUse) {
+            entry = &entries[i];
+        }
+    }
+    strcpy(entry->host, host.c_str());
+    return entry;
+}
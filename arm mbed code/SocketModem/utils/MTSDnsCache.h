@@ -0,0 +1,146 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef MTSDNSCACHE_H
+#define MTSDNSCACHE_H
+
+#include "mbed.h"
+#include <string>
+#include "MTSLock.h"
+
+namespace mts
+{
+
+/** This class provides a small fixed size cache of host name to IP address
+* resolutions that is shared by all transports. Successful resolutions are
+* kept for a configurable time to live and failed ones for a shorter negative
+* time to live, so a name that can not be resolved is not retried on every
+* socket open. When refresh is enabled, entries that are about to expire can
+* be fetched with getRefreshCandidate and resolved again by the transport
+* while it is idle, so a busy host name never has to be looked up in the
+* path of a connection. Like the transports, DnsCache uses the singleton
+* pattern. Time is taken from the mbed real time clock. Every method holds the
+* lock of the cache, so transports on different threads can share it.
+*/
+class DnsCache
+{
+public:
+    /// The number of host names that can be cached.
+    static const int CACHE_SIZE = 4;
+
+    /// The longest host name that can be cached.
+    static const int MAX_HOST_LENGTH = 63;
+
+    /// An enumeration of lookup results.
+    enum Result {
+        MISS, HIT, NEGATIVE
+    };
+
+    /** This static function is used to create or get a reference to the
+    * DnsCache object shared by all transports.
+    *
+    * @returns a reference to the single DnsCache object.
+    */
+    static DnsCache* getInstance();
+
+    /** Creates an empty DnsCache. Most code should use getInstance instead
+    * so that resolutions are shared.
+    */
+    DnsCache();
+
+    /** This method looks up a host name in the cache.
+    *
+    * @param host the host name to look up.
+    * @param ip set to the cached address in the form xxx.xxx.xxx.xxx on a HIT.
+    * @returns HIT if a valid address is cached, NEGATIVE if a failed resolution
+    * is cached, otherwise MISS.
+    */
+    Result lookup(const std::string& host, std::string& ip);
+
+    /** This method adds a successful resolution to the cache, replacing any
+    * existing entry for the host name.
+    *
+    * @param host the host name.
+    * @param ip the resolved address in the form xxx.xxx.xxx.xxx.
+    */
+    void add(const std::string& host, const std::string& ip);
+
+    /** This method adds a failed resolution to the cache. An existing valid
+    * address is kept, so a failed refresh does not discard a working entry.
+    *
+    * @param host the host name that could not be resolved.
+    */
+    void addFailure(const std::string& host);
+
+    /** This method removes a host name from the cache, for example when a
+    * connection to the cached address fails.
+    *
+    * @param host the host name to remove.
+    */
+    void remove(const std::string& host);
+
+    /** This method removes all entries from the cache.
+    */
+    void clear();
+
+    /** This method sets the time to live for successful and failed resolutions.
+    *
+    * @param ttl seconds a successful resolution is kept. The default is 300.
+    * @param negativeTtl seconds a failed resolution is kept. The default is 30.
+    */
+    void setTtl(unsigned int ttl, unsigned int negativeTtl);
+
+    /** This method enables or disables refreshing entries before they expire.
+    * When enabled, an entry within the last fifth of its time to live that
+    * was used since it was added is reported by getRefreshCandidate.
+    *
+    * @param enabled true to enable refresh. The default is disabled.
+    */
+    void setRefresh(bool enabled);
+
+    /** This method gets a host name that should be resolved again.
+    *
+    * @param host set to the host name to resolve.
+    * @returns true if there is a host name to refresh, otherwise false.
+    */
+    bool getRefreshCandidate(std::string& host);
+
+private:
+    struct Entry {
+        char host[MAX_HOST_LENGTH + 1]; // host name, empty if the entry is unused
+        char ip[16]; // resolved address, empty for a failed resolution
+        time_t added; // time the entry was added
+        time_t expires; // time after which the entry is no longer valid
+        unsigned int lastUse; // use counter value at the last add or hit, for LRU eviction
+        bool hit; // specifies if the entry was used since it was added
+    };
+
+    static DnsCache* instance; // Static pointer to the shared DnsCache object.
+
+    Entry entries[CACHE_SIZE]; // cache entries
+    unsigned int ttl; // seconds a successful resolution is kept
+    unsigned int negativeTtl; // seconds a failed resolution is kept
+    bool refresh; // specifies if near expiry entries are refreshed
+    unsigned int useCounter; // incremented on every add and hit
+    Lock lock; // held by every public method
+
+    Entry* find(const std::string& host); // finds the entry for a host name
+    Entry* allocate(const std::string& host); // finds or frees an entry for a host name
+};
+
+}
+
+#endif /* MTSDNSCACHE_H */
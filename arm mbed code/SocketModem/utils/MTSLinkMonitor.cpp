@@ -0,0 +1,245 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "MTSLinkMonitor.h"
+
+using namespace mts;
+
+LinkMonitor::LinkMonitor(unsigned int intervalMillis)
+    : head(0)
+    , count(0)
+    , interval(intervalMillis)
+    , sampled(false)
+{
+}
+
+void LinkMonitor::setInterval(unsigned int intervalMillis)
+{
+    ScopedLock guard(lock);
+    interval = intervalMillis;
+}
+
+unsigned int LinkMonitor::getInterval()
+{
+    ScopedLock guard(lock);
+    return interval;
+}
+
+bool LinkMonitor::isDue()
+{
+    ScopedLock guard(lock);
+    if (!sampled) {
+        return true;
+    }
+    return timer.read_ms() >= static_cast<int>(interval);
+}
+
+void LinkMonitor::addSample(int signal, int rtt, bool probed, bool registered)
+{
+    ScopedLock guard(lock);
+    push(signal, rtt, probed, registered);
+
+    //Restart the interval timer, this also keeps it from overflowing
+    sampled = true;
+    timer.reset();
+    timer.start();
+}
+
+void LinkMonitor::addRtt(int rtt)
+{
+    ScopedLock guard(lock);
+    //Keep the registration state, only the sampling can tell if it was lost
+    if (count == 0) {
+        push(-1, rtt, true, rtt >= 0);
+        return;
+    }
+    Sample& newest = samples[(head - 1 + HISTORY_SIZE) % HISTORY_SIZE];
+    if (newest.probed) {
+        push(-1, rtt, true, newest.registered);
+    } else {
+        newest.rtt = rtt;
+        newest.probed = true;
+    }
+}
+
+void LinkMonitor::push(int signal, int rtt, bool probed, bool registered)
+{
+    samples[head].signal = signal;
+    samples[head].rtt = rtt;
+    samples[head].probed = probed;
+    samples[head].registered = registered;
+    head = (head + 1) % HISTORY_SIZE;
+    if (count < HISTORY_SIZE) {
+        count++;
+    }
+}
+
+bool LinkMonitor::getSample(int index, Sample& sample)
+{
+    ScopedLock guard(lock);
+    if (index < 0 || index >= count) {
+        return false;
+    }
+    sample = samples[(head - 1 - index + HISTORY_SIZE) % HISTORY_SIZE];
+    return true;
+}
+
+int LinkMonitor::size()
+{
+    ScopedLock guard(lock);
+    return count;
+}
+
+void LinkMonitor::clear()
+{
+    ScopedLock guard(lock);
+    head = count = 0;
+    sampled = false;
+    timer.stop();
+    timer.reset();
+}
+
+int LinkMonitor::getMinRtt()
+{
+    ScopedLock guard(lock);
+    int min = -1;
+    for (int i = 0; i < count; i++) {
+        if (samples[i].rtt >= 0 && (min < 0 || samples[i].rtt < min)) {
+            min = samples[i].rtt;
+        }
+    }
+    return min;
+}
+
+int LinkMonitor::getAvgRtt()
+{
+    ScopedLock guard(lock);
+    int total = 0;
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (samples[i].rtt >= 0) {
+            total += samples[i].rtt;
+            found++;
+        }
+    }
+    return (found == 0) ? -1 : total / found;
+}
+
+int LinkMonitor::getP95Rtt()
+{
+    ScopedLock guard(lock);
+    //Insertion sort a copy, the history is small enough for this to be cheap
+    int sorted[HISTORY_SIZE];
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (samples[i].rtt < 0) {
+            continue;
+        }
+        int j = found++;
+        while (j > 0 && sorted[j - 1] > samples[i].rtt) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = samples[i].rtt;
+    }
+    if (found == 0) {
+        return -1;
+    }
+    //Nearest rank: ceil(0.95 * n) - 1
+    return sorted[(found * 95 + 99) / 100 - 1];
+}
+
+int LinkMonitor::getAvgSignal()
+{
+    ScopedLock guard(lock);
+    int total = 0;
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (samples[i].signal >= 0) {
+            total += samples[i].signal;
+            found++;
+        }
+    }
+    return (found == 0) ? -1 : total / found;
+}
+
+int LinkMonitor::getLoss()
+{
+    ScopedLock guard(lock);
+    int probes = 0;
+    int lost = 0;
+    for (int i = 0; i < count; i++) {
+        if (samples[i].probed) {
+            probes++;
+            if (samples[i].rtt < 0) {
+                lost++;
+            }
+        }
+    }
+    return (probes == 0) ? 0 : (lost * 100) / probes;
+}
+
+int LinkMonitor::getScore()
+{
+    ScopedLock guard(lock);
+    Sample newest;
+    if (!getSample(0, newest)) {
+        return -1;
+    }
+    if (!newest.registered) {
+        return 0;
+    }
+
+    int signalScore = getAvgSignal();
+    if (signalScore < 0) {
+        signalScore = 50;
+    }
+
+    int rttScore = 50;
+    int rtt = getAvgRtt();
+    if (rtt >= 0) {
+        if (rtt <= RTT_GOOD) {
+            rttScore = 100;
+        } else if (rtt >= RTT_BAD) {
+            rttScore = 0;
+        } else {
+            rttScore = 100 - ((rtt - RTT_GOOD) * 100) / (RTT_BAD - RTT_GOOD);
+        }
+    }
+
+    int lossScore = 100 - getLoss();
+
+    return (signalScore * 2 + rttScore * 2 + lossScore) / 5;
+}
+
+int LinkMonitor::csqToSignal(int csq)
+{
+    if (csq < 0 || csq > 31) {
+        return -1;
+    }
+    return (csq * 100) / 31;
+}
+
+int LinkMonitor::rssiToSignal(int dBm)
+{
+    //99 is reported when the RSSI could not be read
+    if (dBm == 99 || dBm > 0) {
+        return -1;
+    }
+    //Map -90 dBm (unusable) to -30 dBm (excellent) onto 0 to 100
+    int signal = ((dBm + 90) * 100) / 60;
+    return MAX(0, MIN(100, signal));
+}
@@ -0,0 +1,196 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef MTSLINKMONITOR_H
+#define MTSLINKMONITOR_H
+
+#include "mbed.h"
+#include "Vars.h"
+#include "MTSLock.h"
+
+namespace mts
+{
+
+/** This class keeps a fixed size history of link quality samples for a
+* communications device and reduces them to a few simple statistics and a
+* single quality score. A sample is made up of a normalized signal level,
+* an optional round trip time measurement (ping or socket open time) and
+* the registration state of the link. The class does not talk to the
+* radio itself, the transport classes like Cellular and Wifi feed it
+* samples at the rate configured with setInterval. Every method holds the
+* lock of the monitor, so it can be fed and read from different threads.
+*/
+class LinkMonitor
+{
+public:
+    /// The number of samples kept in the history ring.
+    static const int HISTORY_SIZE = 16;
+
+    /// Round trip times at or below this value in milliseconds score 100.
+    static const int RTT_GOOD = 250;
+
+    /// Round trip times at or above this value in milliseconds score 0.
+    static const int RTT_BAD = 5000;
+
+    /** This structure contains the data for a single link sample.
+    */
+    struct Sample {
+        /// Signal level from 0 (none) to 100 (excellent), -1 if unknown
+        int signal;
+        /// Round trip time in milliseconds, -1 if the probe failed or was not run
+        int rtt;
+        /// Specifies if a round trip probe was run for this sample
+        bool probed;
+        /// Specifies if the link was registered or associated
+        bool registered;
+    };
+
+    /** Creates a LinkMonitor object with an empty history.
+    *
+    * @param intervalMillis the minimum time between samples in milliseconds.
+    * The default is 30 seconds.
+    */
+    LinkMonitor(unsigned int intervalMillis = 30000);
+
+    /** This method sets the minimum time between samples that is used by isDue.
+    *
+    * @param intervalMillis the sample interval in milliseconds.
+    */
+    void setInterval(unsigned int intervalMillis);
+
+    /** This method returns the current sample interval.
+    *
+    * @returns the sample interval in milliseconds.
+    */
+    unsigned int getInterval();
+
+    /** This method determines if a new sample should be taken, which is the
+    * case when no sample was added with addSample yet or the sample interval
+    * has expired since the last one. Round trip times added with addRtt do not
+    * restart the interval.
+    *
+    * @returns true if a sample is due, otherwise false.
+    */
+    bool isDue();
+
+    /** This method adds a sample to the history, overwriting the oldest sample
+    * once the history is full.
+    *
+    * @param signal the signal level from 0 to 100 or -1 if unknown.
+    * @param rtt the round trip time in milliseconds or -1 if the probe failed.
+    * @param probed true if a round trip probe was run for this sample.
+    * @param registered true if the link was registered or associated.
+    */
+    void addSample(int signal, int rtt, bool probed, bool registered);
+
+    /** This method adds a round trip time measured outside of the sampling,
+    * for example the time taken to open a socket. It is stored on the newest
+    * sample if that has no round trip time yet, otherwise a sample is added
+    * with an unknown signal level and the registration state of the newest
+    * sample. Without a history the link counts as registered if rtt is valid.
+    *
+    * @param rtt the round trip time in milliseconds or -1 if the probe failed.
+    */
+    void addRtt(int rtt);
+
+    /** This method gets a sample from the history.
+    *
+    * @param index the index of the sample where 0 is the newest.
+    * @param sample the structure the sample will be copied into.
+    * @returns true if the sample exists, otherwise false.
+    */
+    bool getSample(int index, Sample& sample);
+
+    /** This method returns the number of samples currently in the history.
+    *
+    * @returns the number of samples.
+    */
+    int size();
+
+    /** This method clears all samples from the history.
+    */
+    void clear();
+
+    /** This method returns the lowest successful round trip time in the history.
+    *
+    * @returns the round trip time in milliseconds or -1 if there is none.
+    */
+    int getMinRtt();
+
+    /** This method returns the average successful round trip time in the history.
+    *
+    * @returns the round trip time in milliseconds or -1 if there is none.
+    */
+    int getAvgRtt();
+
+    /** This method returns the 95th percentile successful round trip time in
+    * the history.
+    *
+    * @returns the round trip time in milliseconds or -1 if there is none.
+    */
+    int getP95Rtt();
+
+    /** This method returns the average of all known signal levels in the history.
+    *
+    * @returns the signal level from 0 to 100 or -1 if there is none.
+    */
+    int getAvgSignal();
+
+    /** This method returns the percentage of round trip probes that failed.
+    *
+    * @returns the loss from 0 to 100 percent, 0 if no probes were run.
+    */
+    int getLoss();
+
+    /** This method reduces the history to a single quality score. The score
+    * weights the average signal level and the average round trip time at 40%
+    * each and the probe success rate at 20%. Unknown components count as 50.
+    * A link that is not registered in the newest sample always scores 0.
+    *
+    * @returns the score from 0 (unusable) to 100 (excellent) or -1 if there
+    * are no samples.
+    */
+    int getScore();
+
+    /** A static method for converting a cellular CSQ value to a signal level.
+    *
+    * @param csq the CSQ value from 0 to 31, or 99 if unknown.
+    * @returns the signal level from 0 to 100 or -1 if unknown.
+    */
+    static int csqToSignal(int csq);
+
+    /** A static method for converting a WiFi RSSI value to a signal level.
+    *
+    * @param dBm the RSSI in dBm, or 99 if unknown.
+    * @returns the signal level from 0 to 100 or -1 if unknown.
+    */
+    static int rssiToSignal(int dBm);
+
+private:
+    Sample samples[HISTORY_SIZE]; // history ring of samples
+    int head; // index where the next sample is written
+    int count; // number of valid samples in the ring
+    unsigned int interval; // minimum time between samples in milliseconds
+    bool sampled; // specifies if a sample was added with addSample since the last clear
+    Timer timer; // time since the last sample was added with addSample
+    Lock lock; // held by every public method
+
+    void push(int signal, int rtt, bool probed, bool registered); // writes a sample into the ring
+};
+
+}
+
+#endif /* MTSLINKMONITOR_H */
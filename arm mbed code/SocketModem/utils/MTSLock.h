@@ -0,0 +1,82 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef MTSLOCK_H
+#define MTSLOCK_H
+
+#include "mbed.h"
+#ifdef MTS_RTOS
+#include "rtos.h"
+#endif
+
+namespace mts
+{
+
+/** This class is the lock that a transport like Cellular or Wifi holds for
+* every socket operation and for the whole of every command sequence, so that
+* socket data and AT commands from several threads never interleave on the
+* shared UART. The lock is recursive, a thread that holds it can take it again.
+*
+* When the library is built with MTS_RTOS defined the lock is an rtos::Mutex.
+* Without MTS_RTOS the lock does nothing and the library is single-threaded
+* only: it must then only be used from the main loop, interrupt handlers post
+* their work to the RequestQueue of the Transport class instead. The lock must
+* never be taken in an interrupt handler.
+*/
+class Lock
+{
+public:
+    /** This method waits until the lock is free and takes it.
+    */
+    void acquire() {
+#ifdef MTS_RTOS
+        mutex.lock();
+#endif
+    }
+
+    /** This method releases the lock once for every acquire.
+    */
+    void release() {
+#ifdef MTS_RTOS
+        mutex.unlock();
+#endif
+    }
+
+private:
+#ifdef MTS_RTOS
+    rtos::Mutex mutex; // recursive mutex of the RTX kernel
+#endif
+};
+
+/** This class holds a Lock for its lifetime, so the lock is released on every
+* return path of the method that declares it.
+*/
+class ScopedLock
+{
+public:
+    ScopedLock(Lock& lock) : lock(lock) {
+        lock.acquire();
+    }
+    ~ScopedLock() {
+        lock.release();
+    }
+private:
+    Lock& lock;
+};
+
+}
+
+#endif /* MTSLOCK_H */
@@ -0,0 +1,159 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "MTSRequestQueue.h"
+
+using namespace mts;
+
+RequestQueue::RequestQueue()
+    : head(0)
+    , count(0)
+    , running(false)
+#ifdef MTS_RTOS
+    , pending(0)
+    , thread(NULL)
+    , owner(NULL)
+#endif
+{
+}
+
+RequestQueue::Request::Request()
+#ifdef MTS_RTOS
+    : finished(NULL)
+#endif
+{
+}
+
+RequestQueue::~RequestQueue()
+{
+#ifdef MTS_RTOS
+    if(thread != NULL) {
+        thread->terminate();
+        delete thread;
+    }
+#endif
+}
+
+bool RequestQueue::post(void(*fptr)(void))
+{
+    Request request;
+    request.function.attach(fptr);
+    return add(request);
+}
+
+bool RequestQueue::call(void(*fptr)(void))
+{
+    FunctionPointer request(fptr);
+    return run(request);
+}
+
+int RequestQueue::service(int max)
+{
+    //A request that calls back into the queue must not run the next one
+    if(running) {
+        return 0;
+    }
+    running = true;
+    int done = 0;
+    while(max < 0 || done < max) {
+        __disable_irq();
+        if(count == 0) {
+            __enable_irq();
+            break;
+        }
+        Request request = requests[head];
+        __enable_irq();
+
+        request.function.call();
+
+        //Only release the slot after the request ran, so it can not be overwritten
+        __disable_irq();
+        head = (head + 1) % QUEUE_SIZE;
+        count--;
+        __enable_irq();
+#ifdef MTS_RTOS
+        if(request.finished != NULL) {
+            request.finished->release();
+        }
+#endif
+        done++;
+    }
+    running = false;
+    return done;
+}
+
+int RequestQueue::size()
+{
+    return count;
+}
+
+bool RequestQueue::add(const Request& request)
+{
+    __disable_irq();
+    if(count == QUEUE_SIZE) {
+        __enable_irq();
+        return false;
+    }
+    requests[(head + count) % QUEUE_SIZE] = request;
+    count++;
+    __enable_irq();
+#ifdef MTS_RTOS
+    pending.release();
+#endif
+    return true;
+}
+
+bool RequestQueue::run(const FunctionPointer& function)
+{
+#ifdef MTS_RTOS
+    if(thread != NULL && rtos::Thread::gettid() != owner) {
+        rtos::Semaphore finished(0);
+        Request request;
+        request.function = function;
+        request.finished = &finished;
+        if(!add(request)) {
+            return false;
+        }
+        finished.wait();
+        return true;
+    }
+#endif
+    //Called by the owner, which may be in the middle of a sequence of
+    //commands, so posted requests are left for service
+    FunctionPointer request = function;
+    request.call();
+    return true;
+}
+
+#ifdef MTS_RTOS
+void RequestQueue::start(osPriority priority)
+{
+    if(thread == NULL) {
+        thread = new rtos::Thread(&RequestQueue::loop, this, priority);
+    }
+}
+
+void RequestQueue::loop(void const* argument)
+{
+    RequestQueue* queue = (RequestQueue*)argument;
+    queue->owner = rtos::Thread::gettid();
+    while(true) {
+        queue->pending.wait();
+        //Requests released while one was running are picked up by the same pass
+        queue->service();
+    }
+}
+#endif
@@ -0,0 +1,159 @@
+/* Universal Socket Modem Interface Library
+* Copyright (c) 2013 Multi-Tech Systems
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef MTSREQUESTQUEUE_H
+#define MTSREQUESTQUEUE_H
+
+#include "mbed.h"
+#ifdef MTS_RTOS
+#include "rtos.h"
+#endif
+
+namespace mts
+{
+
+/** This class moves work on a transport like Cellular or Wifi out of contexts
+* that must not use it directly. Requests are run in order by the owner of the
+* queue.
+*
+* Interrupt handlers can never use a transport, they post requests instead, for
+* example a Ticker that samples a sensor and posts the upload. Without an RTOS
+* the owner is the main loop, which calls service regularly. The library is
+* then single-threaded only. When the library is built with MTS_RTOS defined
+* and mbed-rtos linked, start creates a dedicated I/O thread that owns the
+* queue and runs requests as they are posted. Application threads can then
+* also call the transports directly, every transport holds its own lock for
+* each socket operation and command sequence (see MTSLock.h).
+*
+* A request is a function or member function without arguments. Data for the
+* request is kept by the object the member function is called on.
+*/
+class RequestQueue
+{
+public:
+    /// The maximum number of requests that can be pending.
+    static const int QUEUE_SIZE = 8;
+
+    /** Creates an empty RequestQueue.
+    */
+    RequestQueue();
+
+    /** Destructs a RequestQueue. Pending requests are not run.
+    */
+    ~RequestQueue();
+
+    /** This method adds a request to the queue and returns without waiting for
+    * it to run. It can be called from an interrupt handler.
+    *
+    * @param fptr the function to run.
+    * @returns true if the request was queued, false if the queue is full.
+    */
+    bool post(void(*fptr)(void));
+
+    /** This method adds a request to the queue and returns without waiting for
+    * it to run. It can be called from an interrupt handler.
+    *
+    * @param tptr a pointer to the object to call the member function on.
+    * @param mptr a pointer to the member function to run.
+    * @returns true if the request was queued, false if the queue is full.
+    */
+    template<typename T>
+    bool post(T* tptr, void(T::*mptr)(void)) {
+        Request request;
+        request.function.attach(tptr, mptr);
+        return add(request);
+    }
+
+    /** This method runs a request after all requests posted before it and
+    * waits until it has run. It must not be called from an interrupt handler.
+    * When called by the owner of the transport, which is any context while no
+    * I/O thread was started, the request is run directly and posted requests
+    * stay queued for service.
+    *
+    * @param fptr the function to run.
+    * @returns true if the request was run, false if the queue is full.
+    */
+    bool call(void(*fptr)(void));
+
+    /** This method runs a request after all requests posted before it and
+    * waits until it has run. It must not be called from an interrupt handler.
+    * When called by the owner of the transport, which is any context while no
+    * I/O thread was started, the request is run directly and posted requests
+    * stay queued for service.
+    *
+    * @param tptr a pointer to the object to call the member function on.
+    * @param mptr a pointer to the member function to run.
+    * @returns true if the request was run, false if the queue is full.
+    */
+    template<typename T>
+    bool call(T* tptr, void(T::*mptr)(void)) {
+        FunctionPointer request;
+        request.attach(tptr, mptr);
+        return run(request);
+    }
+
+    /** This method runs pending requests in the order they were posted. It must
+    * only be called by the owner of the transport, which is the main loop when
+    * no I/O thread was started.
+    *
+    * @param max the maximum number of requests to run, -1 to run all of them.
+    * @returns the number of requests that were run.
+    */
+    int service(int max = -1);
+
+    /** This method returns the number of pending requests.
+    *
+    * @returns the number of requests waiting to run.
+    */
+    int size();
+
+#ifdef MTS_RTOS
+    /** This method starts the I/O thread that owns the transport and runs
+    * requests as they are posted. After this service must not be called.
+    *
+    * @param priority the priority of the I/O thread.
+    */
+    void start(osPriority priority = osPriorityAboveNormal);
+#endif
+
+private:
+    struct Request {
+        Request();
+        FunctionPointer function; // function to run
+#ifdef MTS_RTOS
+        rtos::Semaphore* finished; // released once the request has run, NULL for posted requests
+#endif
+    };
+
+    Request requests[QUEUE_SIZE]; // ring of pending requests
+    volatile int head; // index of the next request to run
+    volatile int count; // number of pending requests
+    volatile bool running; // specifies if a request is being run, to prevent reentrance
+
+    bool add(const Request& request); // queues a request
+    bool run(const FunctionPointer& function); // runs a request in order and waits for it
+
+#ifdef MTS_RTOS
+    rtos::Semaphore pending; // released once for every posted request
+    rtos::Thread* thread; // the I/O thread, NULL until started
+    osThreadId owner; // id of the I/O thread
+    static void loop(void const* argument); // body of the I/O thread
+#endif
+};
+
+}
+
+#endif /* MTSREQUESTQUEUE_H */
@@ -16,6 +16,9 @@
 
 #include "Wifi.h"
 #include "MTSText.h"
+#include "MTSDnsCache.h"
+#include <cstdlib>
+#include <cstring>
 
 #if 0
 //Enable debug
@@ -27,6 +30,10 @@
 
 Wifi* Wifi::instance = NULL;
 
+const char* Wifi::PROMPT = "<4.00>";
+const char* Wifi::OPEN_MARKER = "*OPEN*";
+const char* Wifi::CLOSE_MARKER = "*CLOS*";
+
 Wifi* Wifi::getInstance()
 {
     if(instance == NULL) {
@@ -51,12 +58,20 @@ bool Wifi::sortInterfaceMode(void)
     return true;
 }
 
-bool Wifi::init(MTSBufferedIO* io)
+bool Wifi::init(MTSBufferedIO* io, PinName STATUS)
 {
+    ScopedLock guard(lock);
     if (io == NULL) {
         return false;
     }
     instance->io = io;
+    if(status) {
+        delete status;
+        status = NULL;
+    }
+    if (STATUS != NC) {
+        status = new DigitalIn(STATUS);
+    }
 
     // start from the same place each time
     reset();
@@ -95,12 +110,30 @@ bool Wifi::init(MTSBufferedIO* io)
         return false;
     }
 
+    //Set the markers used to track the socket state from the data stream
+    if (sendBasicCommand(std::string("set comm open ") + OPEN_MARKER, 1000) != SUCCESS ||
+            sendBasicCommand(std::string("set comm close ") + CLOSE_MARKER, 1000) != SUCCESS) {
+        printf("[ERROR] Failed to set connection markers\n\r");
+        return false;
+    }
+
+    //Drive GPIO6 high while a TCP connection is open
+    if (status != NULL && sendBasicCommand("set sys iofunc 0x40", 1000) != SUCCESS) {
+        printf("[ERROR] Failed to set connection status pin\n\r");
+        return false;
+    }
+
     //Set device into DHCP mode by default
     if (sendBasicCommand("set ip dhcp 1", 1000) != SUCCESS) {
         printf("[ERROR] Failed to set to default DHCP mode\n\r");
         return false;
     }
 
+    //Forward small requests promptly instead of using the factory flush settings
+    if (setForwarding(LATENCY) != SUCCESS) {
+        printf("[WARNING] Failed to set packet forwarding profile\n\r");
+    }
+
     return true;
 }
 
@@ -108,6 +141,9 @@ Wifi::Wifi(MTSBufferedIO* io)
     : io(io)
     , wifiConnected(false)
     , _ssid("")
+    , securityType(NONE)
+    , securityKey("")
+    , dhcp(true)
     , mode(TCP)
     , socketOpened(false)
     , socketCloseable(true)
@@ -115,16 +151,29 @@ Wifi::Wifi(MTSBufferedIO* io)
     , local_address("")
     , host_port(0)
     , cmdOn(false)
+    , sessionDepth(0)
+    , status(NULL)
+    , markerMatch(0)
+    , markerClose(false)
+    , markerStart(0)
+    , markerLength(0)
+    , openState(OPEN_IDLE)
+    , openResolved(false)
 {
-
+    forwardingKnown = false;
+    dataTimer.start();
+    resetCommandStats();
+    clearAssociation();
 }
 
 Wifi::~Wifi()
 {
+    delete status;
 }
 
 bool Wifi::connect()
 {
+    ScopedLock guard(lock);
     //Check if socket is open
     if(socketOpened) {
         return true;
@@ -140,48 +189,118 @@ bool Wifi::connect()
         return false;
     }
 
-    if(!setCmdMode(true)) {
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
         return false;
     }
 
-    //Possibly add a scan command here and look for the network....
+    //Try the cached channel of the last association first
+    if (association.ssid.compare(_ssid) == 0 && association.channel > 0) {
+        printf("[DEBUG] Making SSID Rejoin Attempt. SSID[%s] Channel[%d]\r\n", _ssid.c_str(), association.channel);
+        //Reuse the previous DHCP lease if it has not expired
+        if (dhcp && sendBasicCommand("set ip dhcp 3", 1000) != SUCCESS) {
+            printf("[WARNING] Failed to set DHCP cache mode\r\n");
+        }
+        bool joined = join(association.channel, REJOIN_TIMEOUT);
+        if (dhcp && sendBasicCommand("set ip dhcp 1", 1000) != SUCCESS) {
+            printf("[WARNING] Failed to restore DHCP mode\r\n");
+        }
+        if (joined) {
+            return true;
+        }
+    }
 
     //join my_network
     printf("[DEBUG] Making SSID Connection Attempt. SSID[%s]\r\n", _ssid.c_str());
-    std::string result = sendCommand("join " + _ssid, 15000, "GW=");
+    return join(0, JOIN_TIMEOUT);
+}
+
+bool Wifi::join(int channel, int timeoutMillis)
+{
+    char buffer[32];
+    sprintf(buffer, "set wlan channel %d", channel);
+    if (sendBasicCommand(buffer, 1000) != SUCCESS) {
+        printf("[ERROR] Failed to set channel\r\n");
+        return false;
+    }
+
+    std::string result = sendCommand("join " + _ssid, timeoutMillis, "GW=|FAILED");
     //printf("Connect Status: %s\n\r", result.c_str());
 
-    //Check whether connection was successful
-    if(result.find("Associated!") != string::npos) {
-        if(result.find("Static") == string::npos) {
-            int start = result.find("IP=");
-            int stop = result.find(":", start);
-            local_address = result.substr(start + 3, stop - start - 3);
-        }
-        printf("[INFO] WiFi Connection Established: IP[%s]\r\n", local_address.c_str());
-        wifiConnected = true;
+    //Scan all channels again on later joins
+    if (channel != 0 && sendBasicCommand("set wlan channel 0", 1000) != SUCCESS) {
+        printf("[WARNING] Failed to restore auto-scanning mode\r\n");
+    }
 
-        //Report Signal Strength of new connection
-        wait(1); //Needed for signal strength to be available
-        int rssi = getSignalStrength();
-        printf("[DEBUG] Signal strength (dBm): %d\r\n", rssi);
-    } else {
+    //Check whether connection was successful
+    if(result.find("Associated!") == string::npos) {
         wifiConnected = false;
+        return false;
     }
+    if(result.find("Static") == string::npos) {
+        local_address = parseField(result, "IP=", ":, \r\n");
+    }
+    printf("[INFO] WiFi Connection Established: IP[%s]\r\n", local_address.c_str());
+    wifiConnected = true;
+
+    //Cache the association for a fast rejoin after a drop
+    //The join output ends at GW=, so the gateway is read from the ip settings
+    std::string net = sendCommand("show net", 2000);
+    std::string ip = sendCommand("show ip", 2000);
+    std::string chan = parseField(net, "Chan=", ", \r\n");
+    association.ssid = _ssid;
+    association.channel = chan.size() ? atoi(chan.c_str()) : atoi(parseField(result, "chan=", ", \r\n").c_str());
+    association.bssid = parseField(net, "AP=", ", \r\n");
+    association.ip = local_address;
+    association.gateway = parseField(ip, "GW=", ", \r\n");
+    association.dhcp = dhcp;
+    DBG("Association: Channel[%d] AP[%s] GW[%s]", association.channel, association.bssid.c_str(), association.gateway.c_str());
 
-    return wifiConnected;
+    return true;
+}
+
+std::string Wifi::parseField(const std::string& text, const std::string& name, const char* stops)
+{
+    size_t start = text.find(name);
+    if(start == string::npos) {
+        return "";
+    }
+    start += name.size();
+    size_t stop = text.find_first_of(stops, start);
+    if(stop == string::npos) {
+        stop = text.size();
+    }
+    return text.substr(start, stop - start);
+}
+
+Wifi::Association Wifi::getAssociation()
+{
+    return association;
+}
+
+void Wifi::clearAssociation()
+{
+    association.ssid = "";
+    association.channel = 0;
+    association.bssid = "";
+    association.ip = "";
+    association.gateway = "";
+    association.dhcp = true;
 }
 
 void Wifi::disconnect()
 {
-    wait(5.0f);
+    ScopedLock guard(lock);
     printf("[DEBUG] Disconnecting from network\r\n");
 
     if(socketOpened) {
         close();
     }
 
-    if(!setCmdMode(true)) {
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
         printf("[ERROR] Failed in disconnecting from network.  Continuing ...\r\n");
     }
 
@@ -199,6 +318,7 @@ void Wifi::disconnect()
 
 bool Wifi::isConnected()
 {
+    ScopedLock guard(lock);
     //1) Check if SSID was set
     if(_ssid.size() == 0) {
         printf("[DEBUG] SSID is not set\r\n");
@@ -211,8 +331,9 @@ bool Wifi::isConnected()
         return true;
     }
 
-    //Check command mode.
-    if(!setCmdMode(true)) {
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
         return false;
     }
 
@@ -243,13 +364,27 @@ bool Wifi::bind(unsigned int port)
 
 bool Wifi::open(const std::string& address, unsigned int port, Mode mode)
 {
+    ScopedLock guard(lock);
+    if(!startOpen(address, port, mode)) {
+        return false;
+    }
+    while(checkOpen() == OPENING) {
+        io->waitReadable(100);
+    }
+    return socketOpened;
+}
+
+bool Wifi::startOpen(const std::string& address, unsigned int port, Mode mode)
+{
+    ScopedLock guard(lock);
     char buffer[256] = {0};
     printf("[DEBUG] Attempting to Open Socket\r\n");
+    openState = OPEN_FAILED;
 
     //1) Check that we do not have a live connection up
     if(socketOpened) {
         //Check that the address, port, and mode match
-        if(host_address != address || host_port != port || this->mode != mode) {
+        if(openAddress != address || host_port != port || this->mode != mode) {
             if(this->mode == TCP) {
                 printf("[ERROR] TCP socket already opened (%s:%d)\r\n", host_address.c_str(), host_port);
             } else {
@@ -259,6 +394,7 @@ bool Wifi::open(const std::string& address, unsigned int port, Mode mode)
         }
 
         printf("[DEBUG] Socket already opened\r\n");
+        openState = OPENED;
         return true;
     }
 
@@ -280,8 +416,9 @@ bool Wifi::open(const std::string& address, unsigned int port, Mode mode)
         }
     }
 
-    //Check command mode
-    if(!setCmdMode(true)) {
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
         return false;
     }
 
@@ -305,7 +442,8 @@ bool Wifi::open(const std::string& address, unsigned int port, Mode mode)
 
     //Check if address of URL
     std::vector<std::string> tmp = Text::split(address, '.');
-    if(tmp.size() != 4) {
+    bool resolved = (tmp.size() != 4);
+    if(resolved) {
         std::string ip = getHostByName(address);
         if(ip.size() != 0) {
             host_address = ip;
@@ -329,56 +467,139 @@ bool Wifi::open(const std::string& address, unsigned int port, Mode mode)
     }
 
     // Try and Connect
-    std::string sMode;
-    std::string sOpenSocketCmd;
-    if(mode == TCP) {
-        sOpenSocketCmd = "open";
-        sMode = "TCP";
-    } else {
-        //TODO
-        //sOpenSocketCmd = "AT#OUDP";
-        //sMode = "UDP";
+    if(mode != TCP) {
+        printf("[ERROR] UDP sockets are not supported\r\n");
+        return false;
+    }
+
+    //Send the open command without waiting, checkOpen processes the response.
+    //The command session ends here but the module stays in command mode until
+    //the connection opens.
+    io->rxClear();
+    io->txClear();
+    if(io->write("open", 4, 1000) != 4 || io->write(CR, 1000) != 1) {
+        printf("[ERROR] failed to send command to radio within %d milliseconds\r\n", 1000);
+        return false;
     }
-    string response = sendCommand(sOpenSocketCmd, 10000, "OPEN");
-    if (response.find("OPEN") != string::npos) {
-        printf("[INFO] Opened %s Socket [%s:%d]\r\n", sMode.c_str(), host_address.c_str(), port);
+
+    this->mode = mode;
+    openAddress = address;
+    openResolved = resolved;
+    openResponse = "";
+    openTimer.reset();
+    openTimer.start();
+    openState = OPENING;
+    return true;
+}
+
+IPStack::OpenState Wifi::checkOpen()
+{
+    ScopedLock guard(lock);
+    if(openState != OPENING) {
+        return openState;
+    }
+
+    //Read one byte at a time so no socket data after the open marker is consumed
+    char byte;
+    bool done = false;
+    while(!done && io->read(byte) == 1) {
+        openResponse += byte;
+        done = (byte == '*' && openResponse.find(OPEN_MARKER) != string::npos) ||
+               openResponse.find("FAILED") != string::npos || openResponse.find("ERR") != string::npos;
+    }
+
+    bool opened = openResponse.find(OPEN_MARKER) != string::npos;
+    if(!done && openTimer.read_ms() < OPEN_TIMEOUT) {
+        return OPENING;
+    }
+
+    if (opened) {
+        printf("[INFO] Opened TCP Socket [%s:%d]\r\n", host_address.c_str(), host_port);
         socketOpened = true;
         cmdOn = false;
+        resetMarkers();
+        dataTimer.reset();
     } else {
-        printf("[WARNING] Unable to open %s Socket [%s:%d]\r\n", sMode.c_str(),  host_address.c_str(), port);
+        printf("[WARNING] Unable to open TCP Socket [%s:%d]\r\n", host_address.c_str(), host_port);
         socketOpened = false;
+        if(openResolved) {
+            //The cached address may be stale, resolve it again next time
+            DnsCache::getInstance()->remove(openAddress);
+        }
     }
+    //TCP open time includes the handshake, record it as a round trip sample
+    linkMonitor.addRtt(socketOpened ? openTimer.read_ms() : -1);
+    openTimer.stop();
 
-    return socketOpened;
+    openState = socketOpened ? OPENED : OPEN_FAILED;
+    return openState;
 }
 
 bool Wifi::isOpen()
 {
-    if(io->readable()) {
-        printf("[DEBUG] Assuming open, data available to read.\n\r");
-        return true;
+    ScopedLock guard(lock);
+    if(status != NULL && socketOpened && !status->read()) {
+        socketOpened = false;
     }
-    if(!setCmdMode(true)) {
-        printf("[ERROR] Failed to properly check if TCP connection is open.\r\n");
-        return socketOpened;
+    if(!socketOpened && io->readable()) {
+        DBG("Assuming open, data available to read");
+        return true;
     }
+    return socketOpened;
+}
+
+int Wifi::readConnectionState()
+{
     std::string response = sendCommand("show connection", 2000, "\n");
     int start = response.find("f");
     if(start != string::npos && response.size() >= (start + 3)) {
-        if(response[start + 3] == '1') {
-            socketOpened = true;
-        } else {
-            socketOpened = false;
+        return (response[start + 3] == '1') ? 1 : 0;
+    }
+    return -1;
+}
+
+void Wifi::filterMarker(char byte)
+{
+    //The module inserts the markers into the data stream, so they are removed
+    //here. Bytes that may start a marker are held back until the marker is
+    //complete or turns out to be payload, which is then put in markerData
+    markerStart = 0;
+    markerLength = 0;
+    if(markerMatch > 0) {
+        const char* marker = OPEN_MARKER;
+        if(markerMatch == 1 ? byte == CLOSE_MARKER[1] : markerClose) {
+            marker = CLOSE_MARKER;
         }
+        if(byte == marker[markerMatch]) {
+            markerClose = (marker == CLOSE_MARKER);
+            if(marker[++markerMatch] == '\0') {
+                socketOpened = !markerClose;
+                markerMatch = 0;
+            }
+            return;
+        }
+        memcpy(markerData, marker, markerMatch);
+        markerLength = markerMatch;
+        markerMatch = 0;
+    }
+    //Both markers start with '*' and contain no other '*'
+    if(byte == '*') {
+        markerMatch = 1;
     } else {
-        printf("[WARNING] Trouble checking TCP Connection status.\n\r");
+        markerData[markerLength++] = byte;
     }
-    return socketOpened;
+}
+
+void Wifi::resetMarkers()
+{
+    markerMatch = 0;
+    markerStart = 0;
+    markerLength = 0;
 }
 
 bool Wifi::close()
 {
-    wait(1);
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return false;
@@ -389,20 +610,24 @@ bool Wifi::close()
         return true;
     }
 
-    if(!setCmdMode(true)) {
+    CommandSession session(this);
+    if(!session.isActive()) {
         printf("[ERROR] Failed to close socket\r\n");
         return false;
     }
 
-    if(isOpen()) {
-        std::string response = sendCommand("close", 3000, "CLOS");
-        if(response.find("CLOS") == string::npos) {
+    std::string response = sendCommand("close", 3000, "CLOS|ERR");
+    if(response.find("CLOS") == string::npos) {
+        //No close marker, check whether the remote side already closed it
+        if(readConnectionState() != 0) {
             printf("[WARNING] Failed to successfully close socket...\r\n");
             return false;
         }
     }
 
-    wait(1); //Wait so the subsequent isOpen calls return correctly.
+    socketOpened = false;
+    openState = OPEN_IDLE;
+    resetMarkers();
     io->rxClear();
     io->txClear();
 
@@ -411,36 +636,111 @@ bool Wifi::close()
 
 int Wifi::read(char* data, int max, int timeout)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return -1;
     }
 
     //Check that nothing is in the rx buffer
-    if(!socketOpened && !io->readable()) {
+    if(!socketOpened && !io->readable() && markerLength == 0) {
         printf("[ERROR] Socket is not open\r\n");
         return -1;
     }
 
-    //Check for data mode
-    if(!setCmdMode(false)) {
-        printf("[ERROR] Failed to read data due to mode\r\n");
+    //Data is only exchanged in data mode, command sessions restore it when they end
+    if(cmdOn) {
+        printf("[ERROR] Module is in command mode, can not read data\r\n");
         return -1;
     }
 
-    int bytesRead = 0;
+    //Held bytes that turned out to be payload come first
+    int bytesRead = MIN(max, markerLength);
+    memcpy(data, markerData + markerStart, bytesRead);
+    markerStart += bytesRead;
+    markerLength -= bytesRead;
 
+    //Space is left for the held bytes, so they can be written back in place
+    //if they are not a marker
+    int space = max - bytesRead - markerMatch;
+    if(space <= 0) {
+        return bytesRead;
+    }
+    char* raw = data + bytesRead + markerMatch;
+    int rawRead = 0;
     if(timeout >= 0) {
-        bytesRead = io->read(data, max, static_cast<unsigned int>(timeout));
+        rawRead = io->read(raw, space, static_cast<unsigned int>(timeout));
     } else {
-        bytesRead = io->read(data, max);
+        rawRead = io->read(raw, space);
+    }
+    if(rawRead > 0) {
+        dataTimer.reset();
+    }
+    for(int i = 0; i < rawRead; i++) {
+        filterMarker(raw[i]);
+        memcpy(data + bytesRead, markerData, markerLength);
+        bytesRead += markerLength;
+        markerLength = 0;
     }
 
     return bytesRead;
 }
 
+int Wifi::peek(const char*& data)
+{
+    ScopedLock guard(lock);
+    if(io == NULL) {
+        printf("[ERROR] MTSBufferedIO not set\r\n");
+        return -1;
+    }
+    if(!socketOpened && !io->readable() && markerLength == 0) {
+        return -1;
+    }
+    //Data is only exchanged in data mode, command sessions restore it when they end
+    if(cmdOn) {
+        return 0;
+    }
+    while(markerLength == 0) {
+        int length = io->peek(data);
+        if(length <= 0) {
+            return length;
+        }
+        if(markerMatch == 0) {
+            //Returns the run up to a possible marker in place
+            const char* marker = static_cast<const char*>(memchr(data, '*', length));
+            if(marker != data) {
+                return (marker == NULL) ? length : marker - data;
+            }
+        }
+        //A marker may start here, decide byte by byte
+        filterMarker(*data);
+        io->consume(1);
+        dataTimer.reset();
+    }
+    data = markerData + markerStart;
+    return markerLength;
+}
+
+void Wifi::consume(int length)
+{
+    ScopedLock guard(lock);
+    if(io == NULL || length <= 0) {
+        return;
+    }
+    if(markerLength > 0) {
+        //The view was of held bytes
+        length = MIN(length, markerLength);
+        markerStart += length;
+        markerLength -= length;
+        return;
+    }
+    io->consume(length);
+    dataTimer.reset();
+}
+
 int Wifi::write(const char* data, int length, int timeout)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return -1;
@@ -451,9 +751,9 @@ int Wifi::write(const char* data, int length, int timeout)
         return -1;
     }
 
-    //Check for data mode
-    if(!setCmdMode(false)) {
-        printf("[ERROR] Failed to write data due to mode\r\n");
+    //Data is only exchanged in data mode, command sessions restore it when they end
+    if(cmdOn) {
+        printf("[ERROR] Module is in command mode, can not write data\r\n");
         return -1;
     }
 
@@ -464,12 +764,16 @@ int Wifi::write(const char* data, int length, int timeout)
     } else {
         bytesWritten = io->write(data, length);
     }
+    if(bytesWritten > 0) {
+        dataTimer.reset();
+    }
 
     return bytesWritten;
 }
 
 unsigned int Wifi::readable()
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return 0;
@@ -483,6 +787,7 @@ unsigned int Wifi::readable()
 
 unsigned int Wifi::writeable()
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return 0;
@@ -495,8 +800,47 @@ unsigned int Wifi::writeable()
     return io->writeable();
 }
 
+int Wifi::poll(int events, int timeoutMillis)
+{
+    if(io == NULL) {
+        printf("[ERROR] MTSBufferedIO not set\r\n");
+        return 0;
+    }
+
+    Timer tmr;
+    tmr.start();
+    while(true) {
+        lock.acquire();
+        int ready = 0;
+        int readable = io->readable();
+        if((events & READABLE) && readable) {
+            ready |= READABLE;
+        }
+        if((events & WRITEABLE) && socketOpened && !cmdOn && io->writeable()) {
+            ready |= WRITEABLE;
+        }
+        if((events & CLOSED) && !isOpen() && !readable) {
+            ready |= CLOSED;
+        }
+        lock.release();
+        int elapsed = tmr.read_ms();
+        if(ready != 0 || (timeoutMillis >= 0 && elapsed >= timeoutMillis)) {
+            return ready;
+        }
+        //Received data wakes the wait, the status pin has no interrupt so it is
+        //sampled every STATUS_POLL_TIME milliseconds. The lock is not held while
+        //sleeping, so other threads can use the module
+        int wait = (timeoutMillis < 0) ? -1 : timeoutMillis - elapsed;
+        if(status != NULL && (wait < 0 || wait > STATUS_POLL_TIME)) {
+            wait = STATUS_POLL_TIME;
+        }
+        io->waitReadable(wait);
+    }
+}
+
 void Wifi::reset()
 {
+    ScopedLock guard(lock);
     if(!sortInterfaceMode()) {
         return;
     }
@@ -507,6 +851,9 @@ void Wifi::reset()
 
     wifiConnected = false;
     _ssid = "";
+    securityType = NONE;
+    securityKey = "";
+    dhcp = true;
     mode = TCP;
     socketOpened = false;
     socketCloseable = true;
@@ -514,6 +861,7 @@ void Wifi::reset()
     local_address = "";
     host_port = 0;
     cmdOn = false;
+    forwardingKnown = false;
     wait(1);
 //    if(!init(io)) {
 //        printf("[ERROR] Failed to reinitialize after reset.\n\r");
@@ -522,15 +870,20 @@ void Wifi::reset()
 
 Code Wifi::setDeviceIP(std::string address)
 {
-    //Check for command mode
-    if(!setCmdMode(true)) {
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
         printf("[ERROR] Failed to set IP due to mode issue\r\n");
         return FAILURE;
     }
 
     //Set to DHCP mode
     if(address.compare("DHCP") == 0) {
-        return sendBasicCommand("set ip dhcp 1", 1000);
+        Code code = sendBasicCommand("set ip dhcp 1", 1000);
+        if(code == SUCCESS) {
+            dhcp = true;
+        }
+        return code;
     }
 
     //Set to static mode and set address
@@ -542,6 +895,7 @@ Code Wifi::setDeviceIP(std::string address)
     if(code != SUCCESS) {
         return code;
     }
+    dhcp = false;
     local_address = address;
     return SUCCESS;
 }
@@ -553,8 +907,14 @@ std::string Wifi::getDeviceIP()
 
 Code Wifi::setNetwork(const std::string& ssid, SecurityType type, const std::string& key)
 {
+    //The module keeps its settings until reset, only send changes
+    if (ssid.compare(_ssid) == 0 && type == securityType && key.compare(securityKey) == 0) {
+        return SUCCESS;
+    }
+
     //Check the command mode
-    if(!setCmdMode(true)) {
+    CommandSession session(this);
+    if(!session.isActive()) {
         return FAILURE;
     }
 
@@ -582,19 +942,80 @@ Code Wifi::setNetwork(const std::string& ssid, SecurityType type, const std::str
     }
 
     _ssid = ssid;
+    securityType = type;
+    securityKey = key;
     return SUCCESS;
 }
 
 Code Wifi::setDNS(const std::string& dnsName)
 {
     //Check the command mode
-    if(!setCmdMode(true)) {
+    CommandSession session(this);
+    if(!session.isActive()) {
         return FAILURE;
     }
 
     return sendBasicCommand("set dns name " + dnsName, 1000);
 }
 
+Code Wifi::setForwarding(ForwardingProfile profile)
+{
+    Forwarding settings;
+    if (profile == THROUGHPUT) {
+        settings.size = 1420;
+        settings.time = 50;
+        settings.match = 0;
+    } else {
+        settings.size = 256;
+        settings.time = 5;
+        settings.match = NL;
+    }
+    return setForwarding(settings);
+}
+
+Code Wifi::setForwarding(const Forwarding& settings)
+{
+    if (forwardingKnown && forwarding.size == settings.size && forwarding.time == settings.time &&
+            forwarding.match == settings.match) {
+        return SUCCESS;
+    }
+
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
+        return FAILURE;
+    }
+
+    char buffer[32];
+    Code code;
+    if (!forwardingKnown || forwarding.size != settings.size) {
+        sprintf(buffer, "set comm size %d", settings.size);
+        code = sendBasicCommand(buffer, 1000);
+        if (code != SUCCESS) {
+            return code;
+        }
+        forwarding.size = settings.size;
+    }
+    if (!forwardingKnown || forwarding.time != settings.time) {
+        sprintf(buffer, "set comm time %d", settings.time);
+        code = sendBasicCommand(buffer, 1000);
+        if (code != SUCCESS) {
+            return code;
+        }
+        forwarding.time = settings.time;
+    }
+    if (!forwardingKnown || forwarding.match != settings.match) {
+        sprintf(buffer, "set comm match %d", (int) settings.match);
+        code = sendBasicCommand(buffer, 1000);
+        if (code != SUCCESS) {
+            return code;
+        }
+        forwarding.match = settings.match;
+    }
+    forwardingKnown = true;
+    return SUCCESS;
+}
+
 int Wifi::getSignalStrength()
 {
     //Signal strength does not report correctly if not connected
@@ -604,7 +1025,8 @@ int Wifi::getSignalStrength()
     }
 
     //Check the command mode
-    if(!setCmdMode(true)) {
+    CommandSession session(this);
+    if(!session.isActive()) {
         printf("[ERROR] Could not get RSSI\n\r");
         return 99;
     }
@@ -625,7 +1047,8 @@ int Wifi::getSignalStrength()
 bool Wifi::ping(const std::string& address)
 {
     //Check the command mode
-    if(!setCmdMode(true)) {
+    CommandSession session(this);
+    if(!session.isActive()) {
         printf("[ERROR] Could not send ping command\n\r");
         return false;
     }
@@ -640,17 +1063,67 @@ bool Wifi::ping(const std::string& address)
     return false;
 }
 
+int Wifi::getPingTime(const std::string& address)
+{
+    //Check the command mode
+    CommandSession session(this);
+    if(!session.isActive()) {
+        printf("[ERROR] Could not send ping command\n\r");
+        return -1;
+    }
+
+    Timer tmr;
+    tmr.start();
+    std::string response = sendCommand("ping " + address, PINGDELAY * 1000, "reply");
+    if (response.find("reply") == std::string::npos) {
+        return -1;
+    }
+    return tmr.read_ms();
+}
+
+bool Wifi::updateLinkQuality(const std::string& address, bool force)
+{
+    ScopedLock guard(lock);
+    if (!force && !linkMonitor.isDue()) {
+        return false;
+    }
+    if (io == NULL || socketOpened) {
+        return false;
+    }
+
+    int signal = -1;
+    int rtt = -1;
+    if (wifiConnected) {
+        signal = LinkMonitor::rssiToSignal(getSignalStrength());
+        rtt = getPingTime(address);
+    }
+
+    linkMonitor.addSample(signal, rtt, wifiConnected, wifiConnected);
+    return true;
+}
+
+LinkMonitor& Wifi::getLinkMonitor()
+{
+    return linkMonitor;
+}
+
 bool Wifi::setCmdMode(bool on)
 {
+    ScopedLock guard(lock);
     if (on) {
         if (cmdOn) {
             return true;
         }
-        wait(.5);
+        //The escape sequence needs a guard time without data in front of it
+        if (socketOpened) {
+            int idle = dataTimer.read_ms();
+            if (idle >= 0 && idle < CMD_GUARD_TIME) {
+                wait_ms(CMD_GUARD_TIME - idle);
+            }
+        }
         std::string response = sendCommand("$$", 2000, "CMD", '$');
         if (response.find("CMD") != string::npos) {
             cmdOn = true;
-            wait(.5);
             return true;
         }
         printf("[ERROR] Failed to enter command mode\n\r");
@@ -669,7 +1142,49 @@ bool Wifi::setCmdMode(bool on)
     }
 }
 
+bool Wifi::startCommandSession()
+{
+    //The lock is held until the matching endCommandSession
+    lock.acquire();
+    sessionDepth++;
+    return setCmdMode(true);
+}
+
+void Wifi::endCommandSession()
+{
+    if (sessionDepth == 0) {
+        return;
+    }
+    //Only the outermost session returns an open socket to data mode
+    if (--sessionDepth == 0 && socketOpened && cmdOn) {
+        setCmdMode(false);
+    }
+    lock.release();
+}
+
 std::string Wifi::getHostByName(std::string url)
+{
+    std::string ip;
+    switch(DnsCache::getInstance()->lookup(url, ip)) {
+        case DnsCache::HIT:
+            return ip;
+        case DnsCache::NEGATIVE:
+            printf("[ERROR] Failed to resolve URL [%s] (cached)\r\n", url.c_str());
+            return "";
+        default:
+            break;
+    }
+
+    ip = lookupHost(url);
+    if(ip.size() != 0) {
+        DnsCache::getInstance()->add(url, ip);
+    } else {
+        DnsCache::getInstance()->addFailure(url);
+    }
+    return ip;
+}
+
+std::string Wifi::lookupHost(const std::string& url)
 {
     std::string response = sendCommand("lookup " + url, 3000, "<4.00>");
     int start = response.find("=");
@@ -683,14 +1198,39 @@ std::string Wifi::getHostByName(std::string url)
     return ip;
 }
 
+bool Wifi::refreshDnsCache()
+{
+    ScopedLock guard(lock);
+    if(io == NULL || socketOpened || !wifiConnected) {
+        return false;
+    }
+
+    std::string url;
+    if(!DnsCache::getInstance()->getRefreshCandidate(url)) {
+        return false;
+    }
+
+    CommandSession session(this);
+    if(!session.isActive()) {
+        return false;
+    }
+    std::string ip = lookupHost(url);
+    if(ip.size() == 0) {
+        DnsCache::getInstance()->addFailure(url);
+        return false;
+    }
+    DnsCache::getInstance()->add(url, ip);
+    return true;
+}
+
 Code Wifi::sendBasicCommand(string command, int timeoutMillis, char esc)
 {
-    if(socketOpened) {
+    if(socketOpened && !cmdOn) {
         printf("[ERROR] socket is open. Can not send AT commands\r\n");
         return ERROR;
     }
 
-    string response = sendCommand(command, timeoutMillis, "AOK", esc);
+    string response = sendCommand(command, timeoutMillis, "AOK|ERR", esc);
     //printf("Response: %s\n\r", response.c_str());
     if (response.size() == 0) {
         return NO_RESPONSE;
@@ -705,6 +1245,7 @@ Code Wifi::sendBasicCommand(string command, int timeoutMillis, char esc)
 
 string Wifi::sendCommand(string command, int timeoutMillis, std::string response, char esc)
 {
+    ScopedLock guard(lock);
     if(io == NULL) {
         printf("[ERROR] MTSBufferedIO not set\r\n");
         return "";
@@ -713,6 +1254,12 @@ string Wifi::sendCommand(string command, int timeoutMillis, std::string response
     //    printf("[ERROR] socket is open. Can not send AT commands\r\n");
     //    return "";
     //}
+    //The module is answering a socket open, its response must not be taken by
+    //a command from another thread. An abandoned open ends at its timeout
+    if(openState == OPENING && checkOpen() == OPENING) {
+        printf("[ERROR] socket open in progress. Can not send commands\r\n");
+        return "";
+    }
 
     io->rxClear();
     io->txClear();
@@ -733,37 +1280,90 @@ string Wifi::sendCommand(string command, int timeoutMillis, std::string response
     }
     DBG("Sending: %s%c", command.data(), esc);
 
-    int timer = 0;
-    size_t previous = 0;
+    //Read data as it arrives and stop as soon as a terminator is seen
+    std::vector<std::string> terminators;
+    if (response.size() != 0) {
+        terminators = Text::split(response, '|');
+    }
+    size_t longest = strlen(PROMPT);
+    for (size_t i = 0; i < terminators.size(); i++) {
+        longest = MAX(longest, terminators[i].size());
+    }
+
+    Timer tmr;
+    Timer idle;
+    tmr.start();
+    idle.start();
     char tmp[256];
-    tmp[255] = 0;
     bool done = false;
-    do {
-        wait(.2);
-        timer = timer + 200;
-        previous = result.size();
-        int size = io->read(tmp, 255, 0);    //1 less than allocated
-        if(size > 0) {
+    bool timedOut = false;
+    while (!done) {
+        int size = io->read(tmp, MIN(io->readable(), 255));
+        if (size > 0) {
+            //Only search the new data and the tail that could hold a split terminator
+            size_t from = (result.size() > longest) ? result.size() - longest : 0;
             result.append(tmp, size);
-            if (response.size() != 0) {
-                if (result.find(response) != string::npos) {
-                    goto exit_func;
-                    //return result;
+            idle.reset();
+            if (terminators.size() != 0) {
+                for (size_t i = 0; i < terminators.size() && !done; i++) {
+                    done = result.find(terminators[i], from) != string::npos;
                 }
             } else {
-                done =  (result.size() == previous);
+                done = result.find(PROMPT, from) != string::npos;
             }
-        }
-        if(timer >= timeoutMillis) {
+        } else if (terminators.size() == 0 && result.size() != 0 && idle.read_ms() >= CMD_IDLE_TIME) {
+            done = true;
+        } else if (tmr.read_ms() >= timeoutMillis) {
             if(!(command.compare("reboot") == 0 || command.compare("") == 0)) {
                 printf("[WARNING] sendCommand [%s] timed out after %d milliseconds\r\n", command.c_str(), timeoutMillis);
             }
+            timedOut = true;
             done = true;
+        } else {
+            //Sleep until more data arrives or the quiet time or timeout expires
+            int remaining = timeoutMillis - tmr.read_ms();
+            if (terminators.size() == 0 && result.size() != 0) {
+                remaining = MIN(remaining, CMD_IDLE_TIME - idle.read_ms());
+            }
+            if (remaining > 0) {
+                io->waitReadable(remaining);
+            }
         }
-    } while (!done);
+    }
+
+    int latency = tmr.read_ms();
+    commandStats.count++;
+    commandStats.totalMillis += latency;
+    commandStats.maxMillis = MAX(commandStats.maxMillis, latency);
+    commandStats.lastMillis = latency;
+    commandStats.lastCommand = command;
+    if (timedOut) {
+        commandStats.timeouts++;
+    }
+
+    //A remote close that happened during the command is reported in its output
+    if(socketOpened && result.find(CLOSE_MARKER) != string::npos) {
+        socketOpened = false;
+    }
 
-exit_func:
     DBG("Result: %s\n\r", result.c_str());
     return result;
 }
 
+Wifi::CommandStats Wifi::getCommandStats()
+{
+    ScopedLock guard(lock);
+    return commandStats;
+}
+
+void Wifi::resetCommandStats()
+{
+    ScopedLock guard(lock);
+    commandStats.count = 0;
+    commandStats.timeouts = 0;
+    commandStats.totalMillis = 0;
+    commandStats.maxMillis = 0;
+    commandStats.lastMillis = 0;
+    commandStats.lastCommand = "";
+}
+
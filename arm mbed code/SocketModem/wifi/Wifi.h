@@ -19,6 +19,8 @@
 
 #include "IPStack.h"
 #include "MTSBufferedIO.h"
+#include "MTSLinkMonitor.h"
+#include "MTSLock.h"
 #include "mbed.h"
 #include <string>
 #include <vector>
@@ -92,6 +94,61 @@ public:
         NONE, WEP64, WEP128, WPA, WPA2
     };
 
+    ///An enumeration of packet forwarding profiles.
+    enum ForwardingProfile {
+        LATENCY, THROUGHPUT
+    };
+
+    /** This structure contains the settings that determine when the module
+    * forwards buffered UART data as a TCP packet. A packet is sent when the
+    * buffer holds size bytes, when no byte arrived for time milliseconds, or
+    * when the match character is received.
+    */
+    struct Forwarding {
+        /// Flush size in bytes (set comm size)
+        int size;
+        /// Flush timer in milliseconds (set comm time)
+        int time;
+        /// Match character that forces a flush, 0 to disable (set comm match)
+        unsigned char match;
+    };
+
+    /** This structure contains latency statistics for the commands sent with
+    * sendCommand.
+    */
+    struct CommandStats {
+        /// Number of commands sent
+        unsigned int count;
+        /// Number of commands that timed out without a terminator
+        unsigned int timeouts;
+        /// Sum of all command latencies in milliseconds
+        unsigned long totalMillis;
+        /// Latency of the slowest command in milliseconds
+        int maxMillis;
+        /// Latency of the last command in milliseconds
+        int lastMillis;
+        /// The last command sent
+        std::string lastCommand;
+    };
+
+    /** This structure contains the parameters of the last successful network
+    * association, which connect uses to rejoin quickly after a drop.
+    */
+    struct Association {
+        /// The SSID that was joined, empty if there is no cached association
+        std::string ssid;
+        /// The channel of the access point
+        int channel;
+        /// The MAC address of the access point
+        std::string bssid;
+        /// The IP address of the device
+        std::string ip;
+        /// The gateway address
+        std::string gateway;
+        /// Specifies if the address was assigned by DHCP
+        bool dhcp;
+    };
+
     /** Destructs a Wifi object and frees all related resources.
     */
     ~Wifi();
@@ -120,14 +177,20 @@ public:
     *
     * @param io the buffered io interface that is attached to the wifi
     * radio module.
+    * @param STATUS this is the GPIO6 TCP connection status signal from the
+    * module. If attached, the module is configured to drive it and isOpen uses
+    * it instead of the *OPEN* and *CLOS* markers alone. The default is not
+    * connected.
     * @returns true if the init was successful, otherwise false.
     */
-    bool init(MTSBufferedIO* io);
+    bool init(MTSBufferedIO* io, PinName STATUS = NC);
 
     /** This method establishes a network connection on the Wif radio module.
     * Note that before calling you NEED to first set the network information
     * including WiFi SSID and optional security key using the setNetwork
-    * method.
+    * method. If the same SSID was joined before, the cached channel is tried
+    * first with a short timeout and, when DHCP is used, the previous lease is
+    * reused. If that fails a full scan join is done.
     *
     * @returns true if the connection was successfully established, otherwise
     * false on an error.
@@ -149,12 +212,17 @@ public:
     // For behavior of the following methods refer to IPStack.h documentation
     virtual bool bind(unsigned int port);
     virtual bool open(const std::string& address, unsigned int port, Mode mode);
-    virtual bool isOpen();
+    virtual bool startOpen(const std::string& address, unsigned int port, Mode mode);
+    virtual OpenState checkOpen();
+    virtual bool isOpen(); // Tracked from the *OPEN*/*CLOS* markers and STATUS pin, no command is sent
     virtual bool close();
     virtual int read(char* data, int max, int timeout = -1);
     virtual int write(const char* data, int length, int timeout = -1);
+    virtual int peek(const char*& data);
+    virtual void consume(int length);
     virtual unsigned int readable();
     virtual unsigned int writeable();
+    virtual int poll(int events, int timeoutMillis);
 
     /** This method performs a soft reboot of the device by issuing the
     * reboot command. If the module is not able to respond to commands
@@ -170,13 +238,28 @@ public:
     * @param command the command to send to the WiFi module without the escape character.
     * @param timeoutMillis the time in millis to wait for a response before returning.
     * @param response the text string to look for and to return immediately after finding.
-    * The default is to look for no specific response.
+    * Several terminators, for example a success and an error response, can be given
+    * separated by '|'. The default is to look for no specific response, in which case
+    * the method returns as soon as the command prompt is received or the radio has
+    * been quiet for 200 ms after it started responding.
     * @param esc escape character to add at the end of the command, defaults to
     * carriage return (CR).  Does not append any character if esc == 0.
+    * The command is sent while holding the lock of the module, see MTSLock.h.
     * @returns all data received from the radio after the command as a string.
     */
     std::string sendCommand(std::string command, int timeoutMillis, std::string response = "", char esc = CR);
 
+    /** This method returns the latency statistics of the commands sent with
+    * sendCommand since the object was created or the statistics were reset.
+    *
+    * @returns the command statistics.
+    */
+    CommandStats getCommandStats();
+
+    /** This method resets the command latency statistics.
+    */
+    void resetCommandStats();
+
     /** A method for sending a basic command to the radio. A basic text command is
     * one that simply has a response of either AOK or ERR without any other information.
     * Note that you cannot send commands and have a tcp connection at the same time
@@ -196,9 +279,22 @@ public:
     * @param ssid the SSID for the network you want to attached to.
     * @param type the type of security used on the network. The default is NONE.
     * @param key the security key for the network. The default is no key.
+    * @returns the standard Code enumeration. Nothing is sent if the same settings
+    * are already in effect.
     */
     Code setNetwork(const std::string& ssid, SecurityType type = NONE, const std::string& key = "");
 
+    /** This method returns the parameters of the last successful association.
+    *
+    * @returns the cached association, with an empty ssid if there is none.
+    */
+    Association getAssociation();
+
+    /** This method clears the cached association so that the next connect
+    * does a full scan join.
+    */
+    void clearAssociation();
+
     /** This method is used to set the IP address or puts the module in DHCP mode.
     *
     * @param address the IP address you want to use in the form of xxx.xxx.xxx.xxx or DHCP
@@ -238,6 +334,64 @@ public:
     */
     bool ping(const std::string& address = "8.8.8.8");
 
+    /** This method is used to measure the round trip time to a server with a
+    * single ping. Note that the time is measured around the ping command and
+    * therefore includes the command processing overhead of the module.
+    *
+    * @param address the address of the server in format xxx.xxx.xxx.xxx.
+    * @returns the round trip time in milliseconds, or -1 if the ping failed.
+    */
+    int getPingTime(const std::string& address = "8.8.8.8");
+
+    /** This method takes a link quality sample if one is due according to the
+    * interval configured on the LinkMonitor. A sample consists of the RSSI,
+    * the association state and, if associated, a timed ping. No sample is
+    * taken while a socket is open, socket open times are recorded instead.
+    * This method is meant to be called periodically from the application loop.
+    *
+    * @param address the address of the server to ping in format xxx.xxx.xxx.xxx.
+    * @param force if true a sample is taken even if the interval has not expired.
+    * @returns true if a sample was taken, otherwise false.
+    */
+    bool updateLinkQuality(const std::string& address = "8.8.8.8", bool force = false);
+
+    /** This method returns the link quality history and statistics for the module.
+    *
+    * @returns a reference to the LinkMonitor object of this module.
+    */
+    LinkMonitor& getLinkMonitor();
+
+    /** This method selects a packet forwarding profile. LATENCY flushes on every
+    * newline and after 5 ms without data, which suits request lines, HTTP headers
+    * and small bodies. THROUGHPUT fills packets up to 1420 bytes and only flushes
+    * after 50 ms without data, which suits bulk bodies. Settings that are already
+    * in effect are not sent again, so this can be called before each request to
+    * pick the profile for it. If a socket is open a command session is used to
+    * apply a changed setting, which costs the command mode guard times, so it is
+    * best called before the socket is opened.
+    *
+    * @param profile the forwarding profile to use.
+    * @returns the standard Code enumeration.
+    */
+    Code setForwarding(ForwardingProfile profile);
+
+    /** This method sets custom packet forwarding settings. Settings that are
+    * already in effect are not sent again.
+    *
+    * @param forwarding the forwarding settings to use.
+    * @returns the standard Code enumeration.
+    */
+    Code setForwarding(const Forwarding& forwarding);
+
+    /** This method resolves one host name from the shared DnsCache again before
+    * it expires, so that opening a socket does not have to wait for a lookup.
+    * Refresh must be enabled on the DnsCache. This method is meant to be called
+    * from the application loop and does nothing while a socket is open.
+    *
+    * @returns true if a host name was resolved, otherwise false.
+    */
+    bool refreshDnsCache();
+
     /** This method is used to set whether the device is in command mode or data mode.
     * In command mode you are able to send configuration and status commands while
     * data mode is used for sending data when you have an open socket connection.
@@ -250,13 +404,36 @@ public:
     */
     bool setCmdMode(bool on);
 
+    /** This method starts a command session, which puts the device in command mode
+    * until the matching endCommandSession call. Sessions can be nested and all of
+    * the native methods of this class run inside one, so wrapping several calls
+    * like getSignalStrength, isConnected and close in a session switches modes
+    * only once. Socket reads and writes never switch modes themselves, they fail
+    * while a session is active on an open socket.
+    * The lock of the device is held for the whole session, so a session started
+    * by one thread is never interleaved with commands or socket data of another.
+    *
+    * @returns true if the device is in command mode, otherwise false.
+    */
+    bool startCommandSession();
+
+    /** This method ends a command session. When the outermost session ends and a
+    * socket is open the device is returned to data mode.
+    */
+    void endCommandSession();
+
 private:
     static Wifi* instance; //Static pointer to the single Cellular object.
 
     MTSBufferedIO* io; //IO interface obect that the radio is accessed through.
+    Lock lock; //Held for every socket operation and command session, see MTSLock.h
 
     bool wifiConnected; //Specifies if a Wifi network session is currently connected.
     std::string _ssid; //A string that holds the SSID for the Wifi module.
+    SecurityType securityType; //The security type set with the SSID
+    std::string securityKey; //The security key set with the SSID
+    bool dhcp; //Specifies if the module is in DHCP mode
+    Association association; //Parameters of the last successful association
 
     Mode mode; //The current socket Mode.
     bool socketOpened; //Specifies if a Socket is presently opened.
@@ -266,11 +443,60 @@ private:
     unsigned int host_port; //Holds the remote port for socket connections.
     std::string host_address; //Holds the remote address for socket connections.
     bool cmdOn; //Determines whether the device is in command mode or not
+    unsigned int sessionDepth; //Nesting depth of command sessions
+    Forwarding forwarding; //Forwarding settings in effect
+    bool forwardingKnown; //Specifies if forwarding holds the settings of the module
+    Timer dataTimer; //Time since data was last read or written on the socket
+    CommandStats commandStats; //Latency statistics of sent commands
+    LinkMonitor linkMonitor; //Holds the link quality history of the module
+    DigitalIn* status; //Maps to the module's GPIO6 TCP connection status signal
+    int markerMatch; //Number of received bytes held back because they start a connection marker
+    bool markerClose; //Specifies if the held bytes start the *CLOS* marker rather than *OPEN*
+    char markerData[6]; //Held bytes that turned out to be payload, not yet returned
+    int markerStart; //Index of the first payload byte in markerData
+    int markerLength; //Number of payload bytes in markerData
+    OpenState openState; //State of the socket open in progress
+    std::string openAddress; //Address passed to the socket open in progress
+    bool openResolved; //Specifies if the open in progress uses a cached resolution
+    std::string openResponse; //Response received so far to the open command
+    Timer openTimer; //Time since the open command was sent
 
     Wifi(); //Private constructor, use the getInstance() method.
     Wifi(MTSBufferedIO* io); //Private constructor, use the getInstance() method.
     bool sortInterfaceMode(void); // module gets in wierd state without IO reset
-    std::string getHostByName(std::string url); // Gets the IP address for a URL
+    std::string getHostByName(std::string url); // Gets the IP address for a URL, using the DnsCache
+    std::string lookupHost(const std::string& url); // Resolves a URL with the module
+    int readConnectionState(); // Queries the socket state, 1 open, 0 closed, -1 unknown
+    void filterMarker(char byte); // Strips connection markers from the data and updates the socket state
+    void resetMarkers(); // Forgets held marker bytes when a socket opens or closes
+    bool join(int channel, int timeoutMillis); // Joins the network on one channel, 0 scans all channels
+    static std::string parseField(const std::string& text, const std::string& name, const char* stops); // Gets the value after name up to a stop character
+
+    static const int CMD_GUARD_TIME = 250; // Idle time in ms required before entering command mode
+    static const int OPEN_TIMEOUT = 10000; // Timeout in ms for opening a socket
+    static const int JOIN_TIMEOUT = 15000; // Timeout in ms for a join with a full scan
+    static const int REJOIN_TIMEOUT = 5000; // Timeout in ms for a join on the cached channel
+    static const int STATUS_POLL_TIME = 10; // Interval in ms the status pin is sampled at while polling
+    static const int CMD_IDLE_TIME = 200; // Quiet time in ms that ends a command without a terminator
+    static const char* PROMPT; // Command prompt that ends the output of every command
+    static const char* OPEN_MARKER; // Sent by the module when a connection opens
+    static const char* CLOSE_MARKER; // Sent by the module when a connection closes
+
+    // Starts a command session for the lifetime of the object
+    class CommandSession
+    {
+    public:
+        CommandSession(Wifi* wifi) : wifi(wifi), active(wifi->startCommandSession()) {}
+        ~CommandSession() {
+            wifi->endCommandSession();
+        }
+        bool isActive() {
+            return active;
+        }
+    private:
+        Wifi* wifi;
+        bool active;
+    };
 };
 
 #endif /* WIFI_H */
\ No newline at end of file
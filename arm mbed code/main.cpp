@@ -107,6 +107,16 @@ int main()
     int ret;
     M2XStreamClient m2xClient(&client, key);
     while (true) {
+        //Keep servicing the board while the connection is set up, receive
+        //then reuses the open socket. Once connected, the M2X client keeps
+        //the connection open between requests
+        if (!client.connected() && client.connectAsync(M2XStreamClient::kDefaultM2XHost, M2XStreamClient::kDefaultM2XPort)) {
+            while (client.connectStatus() == 0) {
+                myled2 = !myled2;
+                wait_ms(100);
+            }
+            myled2 = 0;
+        }
         ret = m2xClient.receive(feed, stream,on_data_point_found,NULL);
      
         wait(5);